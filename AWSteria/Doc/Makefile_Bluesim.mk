@@ -61,3 +61,89 @@ Step_3b_start_hostside:
 	./test
 
 # ================================================================
+# Optional: shared-memory transport instead of TCP
+
+# If env var AWSTERIA_SHM is set to a name (the same name in both
+# terminal windows), the simulation creates a shared-memory segment
+# /dev/shm/<name> instead of listening on TCP port 30000, and the
+# host-side connects to it.  The bytevec traffic then goes through a
+# pair of lock-free rings (see src_Testbench_AWS/Top/SHM_Ring.h),
+# avoiding a system call per packet.  Both processes must be on the
+# same machine.
+
+AWSTERIA_SHM ?= awsteria
+
+.PHONY: Step_3a_start_bluesim_shm
+Step_3a_start_bluesim_shm:
+	cd $(AWSTERIA)/builds/RV64ACDFIMSU_Flute_bluesim_AWS && \
+	AWSTERIA_SHM=$(AWSTERIA_SHM) ./exe_HW_sim
+
+.PHONY: Step_3b_start_hostside_shm
+Step_3b_start_hostside_shm:
+	cd $(AWSTERIA)/src_Host_Side && \
+	AWSTERIA_SHM=$(AWSTERIA_SHM) ./test
+
+# ================================================================
+# Optional: DDR4 timing model
+
+# By default the simulated DDR4s respond as fast as possible.  If env
+# var AWSTERIA_DDR4_TIMING names a config file, each DDR4 burst is
+# delayed by a model of fixed latency, per-bank open rows and a
+# per-channel bandwidth cap, and statistics (latency, row hits, queue
+# occupancy) are printed when the simulation exits.
+
+AWSTERIA_DDR4_TIMING ?= $(AWSTERIA)/builds/Resources/DDR4_timing.cfg
+
+.PHONY: Step_3a_start_bluesim_timed
+Step_3a_start_bluesim_timed:
+	cd $(AWSTERIA)/builds/RV64ACDFIMSU_Flute_bluesim_AWS && \
+	AWSTERIA_DDR4_TIMING=$(AWSTERIA_DDR4_TIMING) ./exe_HW_sim
+
+# ================================================================
+# Optional: backdoor preload of the DDR4 models
+
+# If env var AWSTERIA_PRELOAD names an ELF or Mem-hex32 file, the
+# simulation loads it directly into its DDR4 models at startup, and
+# the host-side skips its DMA download of the image (so set it in both
+# terminal windows).
+
+AWSTERIA_PRELOAD ?= $(AWSTERIA)/src_Host_Side/Mem.hex
+
+.PHONY: Step_3a_start_bluesim_preload
+Step_3a_start_bluesim_preload:
+	cd $(AWSTERIA)/builds/RV64ACDFIMSU_Flute_bluesim_AWS && \
+	AWSTERIA_PRELOAD=$(AWSTERIA_PRELOAD) ./exe_HW_sim
+
+.PHONY: Step_3b_start_hostside_preload
+Step_3b_start_hostside_preload:
+	cd $(AWSTERIA)/src_Host_Side && \
+	AWSTERIA_PRELOAD=$(AWSTERIA_PRELOAD) ./test
+
+# ================================================================
+# Optional: DDR4 snapshot and restore
+
+# If env var AWSTERIA_DDR_SNAPSHOT names a file, the simulation saves
+# the contents of its DDR4 models to it at exit (only non-zero 4 KB
+# pages are stored).  If env var AWSTERIA_DDR_RESTORE names such a
+# file, the simulation restores it at startup (mmap'd copy-on-write, so
+# the file is not modified), before any AWSTERIA_PRELOAD file; the
+# host-side then skips its DMA download (so set it in both windows).
+
+AWSTERIA_DDR_SNAPSHOT ?= $(AWSTERIA)/builds/RV64ACDFIMSU_Flute_bluesim_AWS/DDR4.snapshot
+
+.PHONY: Step_3a_start_bluesim_snapshot
+Step_3a_start_bluesim_snapshot:
+	cd $(AWSTERIA)/builds/RV64ACDFIMSU_Flute_bluesim_AWS && \
+	AWSTERIA_DDR_SNAPSHOT=$(AWSTERIA_DDR_SNAPSHOT) ./exe_HW_sim
+
+.PHONY: Step_3a_start_bluesim_restore
+Step_3a_start_bluesim_restore:
+	cd $(AWSTERIA)/builds/RV64ACDFIMSU_Flute_bluesim_AWS && \
+	AWSTERIA_DDR_RESTORE=$(AWSTERIA_DDR_SNAPSHOT) ./exe_HW_sim
+
+.PHONY: Step_3b_start_hostside_restore
+Step_3b_start_hostside_restore:
+	cd $(AWSTERIA)/src_Host_Side && \
+	AWSTERIA_DDR_RESTORE=$(AWSTERIA_DDR_SNAPSHOT) ./test
+
+# ================================================================
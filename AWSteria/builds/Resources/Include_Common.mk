@@ -49,6 +49,15 @@ BSC_PATH = $(CUSTOM_DIRS):$(CORE_DIRS):$(CHERI_DIRS):$(AXI4_DIRS):$(AWS_TESTBENC
 TOPFILE   ?= $(AWSTERIA)/src_Testbench_AWS/Top/Top_HW_Side.bsv
 TOPMODULE ?= mkTop_HW_Side
 
+# ----------------
+# C sources shared with the host side, linked into the simulator
+# along with C_Imported_Functions.c (ELF and Mem-hex32 parsing for
+# the memory-model preload)
+
+SIM_SHARED_C_SRCS = \
+	$(AWSTERIA)/src_Host_Side/Elf_Segments.c \
+	$(AWSTERIA)/src_Host_Side/Memhex32_read.c
+
 # ================================================================
 # bsc compilation flags
 
@@ -104,7 +113,7 @@ compile: TagTableStructure.bsv
 
 .PHONY: clean
 clean:
-	rm -r -f  *~  Makefile_*  symbol_table.txt  build_dir  obj_dir
+	rm -r -f  *~  Makefile_*  symbol_table.txt  build_dir  obj_dir  obj_dir_t*
 
 .PHONY: full_clean
 full_clean: clean
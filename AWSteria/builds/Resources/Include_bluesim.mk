@@ -26,6 +26,8 @@ SIM_EXE_FILE = exe_HW_sim
 BSC_C_FLAGS += \
 	-Xl -v \
 	-Xc -O3 -Xc++ -O3 \
+	-Xl -lpthread \
+	-Xl -lz \
 
 # You may have to remove this line above
 # for Bluespec_2019.05.beta2-debian9stretch-amd64
@@ -38,7 +40,9 @@ simulator:
 		$(TMP_DIRS) \
 		-e $(TOPMODULE) -o ./$(SIM_EXE_FILE) \
 		$(BSC_C_FLAGS) \
-		$(AWSTERIA)/src_Testbench_AWS/Top/C_Imported_Functions.c
+		-Xc -I$(AWSTERIA)/src_Host_Side \
+		$(AWSTERIA)/src_Testbench_AWS/Top/C_Imported_Functions.c \
+		$(SIM_SHARED_C_SRCS)
 	@echo "INFO: linked bsc-compiled objects into Bluesim executable"
 
 # ================================================================
@@ -36,9 +36,39 @@ SIM_EXE_FILE = exe_HW_sim
 
 VERILATOR_FLAGS = --stats -O3 -CFLAGS -O3 -LDFLAGS -static --x-assign fast --x-initial fast --noassert
 
+# C_Imported_Functions.c uses threads for host comms and trace output,
+# and zlib for trace compression
+VERILATOR_FLAGS += -LDFLAGS -pthread -LDFLAGS -lz
+
 # Verilator flags: use the following to include code to generate VCDs
 # Select trace-depth according to your module hierarchy
 # VERILATOR_FLAGS += --trace  --trace-depth 2  -CFLAGS -DVM_TRACE
+# or compressed FST waveforms (much smaller, and faster on long runs):
+# VERILATOR_FLAGS += --trace-fst  --trace-depth 2  -CFLAGS -DVM_TRACE  -CFLAGS -DVM_TRACE_FST
+# Run with +trace, and optionally +trace_start=<cycle>, +trace_end=<cycle>,
+# +trace_depth=<n> and +trace_ring=<n> (see sim_main.cpp)
+
+# Multithreaded model: 'make simulator VERILATOR_THREADS=<n>' verilates
+# with --threads <n> into obj_dir_t<n> and creates exe_HW_sim_t<n>.
+# The default (0) is the single-threaded exe_HW_sim.
+
+VERILATOR_THREADS ?= 0
+
+ifeq ($(VERILATOR_THREADS),0)
+VERILATOR_OBJ_DIR = obj_dir
+VERILATOR_EXE     = $(SIM_EXE_FILE)
+
+# Verilator flags: include code to save/restore the model, for
+# +checkpoint=<cycle>:<file> and +restore=<file> (see sim_main.cpp).
+# Attach the host side to a restored simulation with AWSTERIA_RESUME=1.
+# (not supported together with --threads)
+VERILATOR_FLAGS += --savable  -CFLAGS -DVM_SAVABLE
+else
+VERILATOR_OBJ_DIR = obj_dir_t$(VERILATOR_THREADS)
+VERILATOR_EXE     = $(SIM_EXE_FILE)_t$(VERILATOR_THREADS)
+
+VERILATOR_FLAGS += --threads $(VERILATOR_THREADS)
+endif
 
 VTOP                = V$(TOPMODULE)_edited
 VERILATOR_RESOURCES = $(AWSTERIA)/builds/Resources/Verilator_resources
@@ -52,17 +82,54 @@ simulator:
 	     tmp1.v                                     > Verilog_RTL/$(TOPMODULE)_edited.v
 	rm   -f  tmp1.v
 	verilator \
+		--Mdir $(VERILATOR_OBJ_DIR) \
 		-IVerilog_RTL \
 		-I$(REPO)/src_bsc_lib_RTL \
 		$(VERILATOR_FLAGS) \
+		-CFLAGS -I$(AWSTERIA)/src_Testbench_AWS/Top \
+		-CFLAGS -I$(AWSTERIA)/src_Host_Side \
 		--cc  $(TOPMODULE)_edited.v \
 		--exe  sim_main.cpp \
-		$(AWSTERIA)/src_Testbench/Top/C_Imported_Functions.c
+		$(AWSTERIA)/src_Testbench_AWS/Top/C_Imported_Functions.c \
+		$(SIM_SHARED_C_SRCS)
 	@echo "INFO: Linking verilated files"
-	cp  -p  $(VERILATOR_RESOURCES)/sim_main.cpp  obj_dir/sim_main.cpp
-	cd obj_dir; \
+	cp  -p  $(VERILATOR_RESOURCES)/sim_main.cpp  $(VERILATOR_OBJ_DIR)/sim_main.cpp
+	cd $(VERILATOR_OBJ_DIR); \
 	   make -j -f V$(TOPMODULE)_edited.mk  $(VTOP); \
-	   cp -p  $(VTOP)  ../$(SIM_EXE_FILE)
-	@echo "INFO: Created verilator executable:    $(SIM_EXE_FILE)"
+	   cp -p  $(VTOP)  ../$(VERILATOR_EXE)
+	@echo "INFO: Created verilator executable:    $(VERILATOR_EXE)"
+
+# ================================================================
+# Thread-count benchmark
+# 'make simulators_mt' builds exe_HW_sim_t<n> for each n in BENCH_THREADS.
+# 'make bench_threads' runs each of them against the host-side program
+# BENCH_HOST (in its own directory; e.g., with AWSTERIA_PRELOAD set for
+# an ISA test or boot image) and reports the simulation speed over
+# BENCH_CYCLES cycles starting at cycle BENCH_START (after the host
+# has connected and the image is loaded).  Logs are in Logs/bench_t<n>*.log
+
+BENCH_THREADS ?= 1 2 4 8
+BENCH_START   ?= 10000
+BENCH_CYCLES  ?= 1000000
+BENCH_HOST    ?= $(AWSTERIA)/src_Host_Side/test
+
+.PHONY: simulators_mt
+simulators_mt:
+	for t in $(BENCH_THREADS); do \
+	    $(MAKE) simulator VERILATOR_THREADS=$$t || exit 1; \
+	done
+
+.PHONY: bench_threads
+bench_threads:
+	mkdir -p Logs
+	for t in $(BENCH_THREADS); do \
+	    ./$(SIM_EXE_FILE)_t$$t  +bench=$(BENCH_START):$(BENCH_CYCLES)  > Logs/bench_t$$t.log  2>&1 & \
+	    sim_pid=$$!; \
+	    (cd $(dir $(BENCH_HOST)) && $(BENCH_HOST))  > Logs/bench_t$${t}_host.log  2>&1 & \
+	    host_pid=$$!; \
+	    wait $$sim_pid; \
+	    kill $$host_pid 2> /dev/null; wait $$host_pid; \
+	    echo "threads $$t: `grep 'Simulation speed' Logs/bench_t$$t.log`"; \
+	done
 
 # ================================================================
@@ -39,6 +39,9 @@ function  void  c_host_recv (int unsigned  data, byte unsigned  bytevec_size);
 import "DPI-C"
 function  void  c_host_send (int unsigned  data, byte unsigned  bytevec_size);
 
+import "DPI-C"
+function  void  c_host_flush (byte unsigned  dummy);
+
 // ****************************************************************
 // ****************************************************************
 // ****************************************************************
@@ -63,3 +66,30 @@ function  int unsigned  c_trace_file_close (byte unsigned dummy);
 // ****************************************************************
 // ****************************************************************
 // ****************************************************************
+
+// Functions for the AWS DDR4 memory model (AWS_DDR4_Model.bsv).
+
+import "DPI-C"
+function  void  c_mem_model_read (output bit [511:0]  result,
+				  byte unsigned       ddr4_num,
+				  longint unsigned    byte_offset);
+
+import "DPI-C"
+function  void  c_mem_model_write (byte unsigned     ddr4_num,
+				   longint unsigned  byte_offset,
+				   bit [511:0]       data,
+				   longint unsigned  strb);
+
+import "DPI-C"
+function  longint unsigned  c_mem_model_timing_req (byte unsigned     ddr4_num,
+						    byte unsigned     is_write,
+						    longint unsigned  byte_offset,
+						    int unsigned      n_beats,
+						    longint unsigned  cycle);
+
+import "DPI-C"
+function  int unsigned  c_mem_model_preload (byte unsigned  dummy);
+
+// ****************************************************************
+// ****************************************************************
+// ****************************************************************
@@ -5,12 +5,28 @@
 #include <verilated.h>
 
 #include <sys/stat.h>  // for 'mkdir'
+#include <inttypes.h>
+#include <signal.h>
 
 #include "VmkTop_HW_Side_edited.h"
+#include "C_Imported_Functions.h"
 
-// If "verilator --trace" is used, include the tracing class
+// If "verilator --trace" or "verilator --trace-fst" is used, include the tracing class
 #if VM_TRACE
-# include <verilated_vcd_c.h>
+# if VM_TRACE_FST
+#  include <verilated_fst_c.h>
+typedef VerilatedFstC Trace_File;
+#  define TRACE_FILE_EXT "fst"
+# else
+#  include <verilated_vcd_c.h>
+typedef VerilatedVcdC Trace_File;
+#  define TRACE_FILE_EXT "vcd"
+# endif
+#endif
+
+// If "verilator --savable" is used, include the save/restore classes
+#if VM_SAVABLE
+# include <verilated_save.h>
 #endif
 
 vluint64_t main_time = 0;    // Current simulation time
@@ -19,6 +35,132 @@ double sc_time_stamp () {    // Called by $time in Verilog
     return main_time;
 }
 
+// Clock period is 10 time units: rising edge at 5, falling edge at 0
+// (mod 10).  The model is only evaluated at these edges (and at the
+// reset transitions), since nothing changes in between.
+
+#define CLK_PERIOD       10
+#define CLK_HALF_PERIOD   5
+
+#if VM_TRACE
+// ================================================================
+// Waveforms: dumped if run with +trace.  Optional plusargs:
+//     +trace_start=<cycle>  start dumping at <cycle> (default: 0)
+//     +trace_end=<cycle>    stop dumping at <cycle> (default: never)
+//     +trace_depth=<n>      levels of hierarchy to dump (default: 99;
+//                           also limited by verilator --trace-depth)
+//     +trace_ring=<n>       "flight recorder": dump alternately into
+//                           vcd/vlt_dump_ring0 and _ring1, switching
+//                           every <n> cycles, so only the last <n> to
+//                           2<n> cycles are kept when the simulation
+//                           ends ($finish, error exit, or interrupt)
+
+static Trace_File* tfp               = NULL;
+static vluint64_t  trace_start_cycle = 0;
+static vluint64_t  trace_end_cycle   = ~ ((vluint64_t) 0);
+static vluint64_t  trace_ring_cycles = 0;
+static vluint64_t  trace_file_start  = 0;    // cycle at which the current file was opened
+static vluint64_t  trace_prev_start  = 0;    // same, for the previous ring file
+static int         trace_ring_num    = 0;    // current ring file (0 or 1)
+static bool        trace_opened      = false;
+
+static void trace_open (vluint64_t cycle) {
+    char filename [64];
+    if (trace_ring_cycles == 0)
+        snprintf (filename, sizeof (filename), "vcd/vlt_dump." TRACE_FILE_EXT);
+    else
+        snprintf (filename, sizeof (filename), "vcd/vlt_dump_ring%0d." TRACE_FILE_EXT, trace_ring_num);
+    if (! trace_opened)
+        VL_PRINTF("Enabling waves into %s at cycle %" PRIu64 "...\n", filename, cycle);
+    trace_opened = true;
+    tfp->open (filename);
+    trace_prev_start = trace_file_start;
+    trace_file_start = cycle;
+}
+
+// Also called at exit, so that waves are flushed on error exits
+static void trace_close (void) {
+    if ((tfp == NULL) || (! tfp->isOpen ()))
+        return;
+    tfp->close ();
+    vluint64_t cycle = main_time / CLK_PERIOD;
+    if ((trace_ring_cycles != 0) && (trace_prev_start != trace_file_start))
+        VL_PRINTF("Waves: cycles %" PRIu64 "..%" PRIu64 " in vcd/vlt_dump_ring%0d." TRACE_FILE_EXT "\n",
+                  trace_prev_start, trace_file_start, 1 - trace_ring_num);
+    VL_PRINTF("Waves: cycles %" PRIu64 "..%" PRIu64 " in vcd/vlt_dump%s." TRACE_FILE_EXT "\n",
+              trace_file_start, cycle,
+              ((trace_ring_cycles == 0) ? "" : (trace_ring_num == 0 ? "_ring0" : "_ring1")));
+}
+
+// SIGINT/SIGTERM only set a flag (nothing else is async-signal-safe);
+// the clock loop then stops, and the trace is closed on the normal exit
+// path.  A second signal has the default effect (e.g., if the
+// simulation is stuck waiting for the host).
+static volatile sig_atomic_t trace_signal_received = 0;
+
+static void trace_signal_handler (int sig) {
+    trace_signal_received = 1;
+    signal (sig, SIG_DFL);
+}
+
+// Called at the start of each cycle
+static void trace_control (vluint64_t cycle) {
+    if (tfp == NULL)
+        return;
+    if (cycle >= trace_end_cycle)
+        trace_close ();
+    else if (! tfp->isOpen ()) {
+        if (cycle >= trace_start_cycle)
+            trace_open (cycle);
+    }
+    else if ((trace_ring_cycles != 0) && ((cycle - trace_file_start) >= trace_ring_cycles)) {
+        tfp->close ();
+        trace_ring_num = 1 - trace_ring_num;
+        trace_open (cycle);
+    }
+}
+#endif
+
+// ================================================================
+// Evaluate the model at time t
+
+static void eval_at (VmkTop_HW_Side_edited* mkTop_HW_Side, vluint64_t t) {
+    main_time = t;
+#if VM_TRACE
+    if (tfp && tfp->isOpen ())
+        tfp->dump(main_time);
+#endif
+    mkTop_HW_Side->eval ();
+}
+
+#if VM_SAVABLE
+// ================================================================
+// Checkpoints: the Verilator model state (and main_time) goes into
+// <filename>; C-side state (host comms, trace file, DDR4 memory model)
+// into <filename>.* (see c_checkpoint_save ()).
+
+static void checkpoint_save (VmkTop_HW_Side_edited* mkTop_HW_Side, const char* filename) {
+    VL_PRINTF("Saving checkpoint at cycle %" PRIu64 " into %s...\n", main_time / CLK_PERIOD, filename);
+    VerilatedSave os;
+    os.open (filename);
+    os << main_time;
+    os << *mkTop_HW_Side;
+    os.close ();
+    c_checkpoint_save (filename);
+}
+
+static void checkpoint_restore (VmkTop_HW_Side_edited* mkTop_HW_Side, const char* filename) {
+    VL_PRINTF("Restoring checkpoint from %s...\n", filename);
+    VerilatedRestore os;
+    os.open (filename);
+    os >> main_time;
+    os >> *mkTop_HW_Side;
+    os.close ();
+    VL_PRINTF("Restored checkpoint at cycle %" PRIu64 "\n", main_time / CLK_PERIOD);
+    c_checkpoint_restore (filename);
+}
+#endif
+
 int main (int argc, char **argv, char **env) {
     Verilated::commandArgs (argc, argv);    // remember args
 
@@ -27,15 +169,31 @@ int main (int argc, char **argv, char **env) {
 #if VM_TRACE
     // If verilator was invoked with --trace argument,
     // and if at run time passed the +trace argument, turn on tracing
-    VerilatedVcdC* tfp = NULL;
+    // (the dump file is opened at +trace_start, see trace_control ())
     const char* flag = Verilated::commandArgsPlusMatch("trace");
     if (flag && 0==strcmp(flag, "+trace")) {
+        int trace_depth = 99;
+        flag = Verilated::commandArgsPlusMatch("trace_start=");
+        if (flag && (flag [0] != 0))
+            trace_start_cycle = strtoull (flag + strlen ("+trace_start="), NULL, 0);
+        flag = Verilated::commandArgsPlusMatch("trace_end=");
+        if (flag && (flag [0] != 0))
+            trace_end_cycle = strtoull (flag + strlen ("+trace_end="), NULL, 0);
+        flag = Verilated::commandArgsPlusMatch("trace_depth=");
+        if (flag && (flag [0] != 0))
+            trace_depth = atoi (flag + strlen ("+trace_depth="));
+        flag = Verilated::commandArgsPlusMatch("trace_ring=");
+        if (flag && (flag [0] != 0))
+            trace_ring_cycles = strtoull (flag + strlen ("+trace_ring="), NULL, 0);
+
         Verilated::traceEverOn(true);  // Verilator must compute traced signals
-        VL_PRINTF("Enabling waves into vcd/vlt_dump.vcd...\n");
-        tfp = new VerilatedVcdC;
-        mkTop_HW_Side->trace(tfp, 99);  // Trace 99 levels of hierarchy
+        tfp = new Trace_File;
+        mkTop_HW_Side->trace(tfp, trace_depth);  // Trace trace_depth levels of hierarchy
         mkdir("vcd", 0777);
-        tfp->open("vcd/vlt_dump.vcd");  // Open the dump file
+
+        atexit (trace_close);
+        signal (SIGINT,  trace_signal_handler);
+        signal (SIGTERM, trace_signal_handler);
     }
 #endif
 
@@ -44,41 +202,109 @@ int main (int argc, char **argv, char **env) {
     mkTop_HW_Side->RST_N = 1;
     mkTop_HW_Side->CLK = 0;
 
+#if VM_SAVABLE
+    // +checkpoint=<cycle>:<file>  save a checkpoint at the start of <cycle>
+    // +restore=<file>             start from a saved checkpoint (skips reset)
+    //     The restored simulation waits for a new host connection; run the
+    //     host side with env var AWSTERIA_RESUME=1 so that it does not
+    //     re-download DDR4 or repeat the startup sequence (see test.c).
+    vluint64_t checkpoint_cycle = 0;
+    char       checkpoint_file [1024] = "";
+    const char* checkpoint_flag = Verilated::commandArgsPlusMatch("checkpoint=");
+    if (checkpoint_flag && (checkpoint_flag [0] != 0)) {
+        if (sscanf (checkpoint_flag, "+checkpoint=%" SCNu64 ":%1023s",
+                    & checkpoint_cycle, checkpoint_file) != 2) {
+            VL_PRINTF("ERROR: expecting +checkpoint=<cycle>:<file>, got %s\n", checkpoint_flag);
+            exit (1);
+        }
+    }
+    const char* restore_flag = Verilated::commandArgsPlusMatch("restore=");
+    if (restore_flag && (restore_flag [0] != 0)) {
+        checkpoint_restore (mkTop_HW_Side, restore_flag + strlen ("+restore="));
+    }
+#endif
+
+    // +bench=<start_cycle>:<n_cycles>  measure simulation speed (with
+    // c_start_timing/c_end_timing) over n_cycles from start_cycle, then finish
+    vluint64_t bench_start_cycle = 0;
+    vluint64_t bench_end_cycle   = 0;
+    const char* bench_flag = Verilated::commandArgsPlusMatch("bench=");
+    if (bench_flag && (bench_flag [0] != 0)) {
+        vluint64_t n_cycles;
+        if (sscanf (bench_flag, "+bench=%" SCNu64 ":%" SCNu64, & bench_start_cycle, & n_cycles) != 2) {
+            VL_PRINTF("ERROR: expecting +bench=<start_cycle>:<n_cycles>, got %s\n", bench_flag);
+            exit (1);
+        }
+        bench_end_cycle = bench_start_cycle + n_cycles;
+    }
+
+    // Reset sequence (skipped if restored from a checkpoint):
+    // RST_N is asserted across the first rising edge of CLK.
+    if (main_time == 0) {
+#if VM_TRACE
+	trace_control (0);
+#endif
+	eval_at (mkTop_HW_Side, 0);
+	mkTop_HW_Side->RST_N = 0;    // assert reset
+	eval_at (mkTop_HW_Side, 2);
+	mkTop_HW_Side->CLK = 1;
+	eval_at (mkTop_HW_Side, CLK_HALF_PERIOD);
+	mkTop_HW_Side->RST_N = 1;    // Deassert reset
+	eval_at (mkTop_HW_Side, 7);
+	main_time = CLK_PERIOD;
+    }
+
+    // One iteration per clock cycle, starting at a falling edge
     while (! Verilated::gotFinish ()) {
 
-	if (main_time == 2) {
-	    mkTop_HW_Side->RST_N = 0;    // assert reset
-	}
-	else if (main_time == 7) {
-	    mkTop_HW_Side->RST_N = 1;    // Deassert reset
+#if VM_SAVABLE
+	if ((checkpoint_file [0] != 0) && (main_time == (checkpoint_cycle * CLK_PERIOD))) {
+	    checkpoint_save (mkTop_HW_Side, checkpoint_file);
 	}
+#endif
 
-	// Toggle clock
-	if ((main_time % 10) == 5) {
-	    mkTop_HW_Side->CLK = 1;
-	}
-	else if ((main_time % 10) == 0) {
-	    mkTop_HW_Side->CLK = 0;
-	}
+	vluint64_t t = main_time;
 
 #if VM_TRACE
-	if (tfp)
-	    tfp->dump(main_time);
+	if (trace_signal_received)
+	    break;
+	trace_control (t / CLK_PERIOD);
 #endif
 
-	mkTop_HW_Side->eval ();
-	main_time++;
+	if (bench_end_cycle != 0) {
+	    if (t == (bench_start_cycle * CLK_PERIOD)) {
+		c_start_timing (bench_start_cycle);
+	    }
+	    else if (t == (bench_end_cycle * CLK_PERIOD)) {
+		c_end_timing (bench_end_cycle);
+		break;
+	    }
+	}
+
+	mkTop_HW_Side->CLK = 0;
+	eval_at (mkTop_HW_Side, t);
+	if (Verilated::gotFinish ())
+	    break;
+
+	mkTop_HW_Side->CLK = 1;
+	eval_at (mkTop_HW_Side, t + CLK_HALF_PERIOD);
+
+	main_time = t + CLK_PERIOD;
     }
 
     mkTop_HW_Side->final ();    // Done simulating
 
     // Close trace if opened
 #if VM_TRACE
-    if (tfp) { tfp->close(); }
+    trace_close ();
 #endif
 
     delete mkTop_HW_Side;
     mkTop_HW_Side = NULL;
 
+#if VM_TRACE
+    if (trace_signal_received)
+	exit (1);
+#endif
     exit (0);
 }
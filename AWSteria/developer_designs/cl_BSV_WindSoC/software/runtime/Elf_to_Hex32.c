@@ -1,7 +1,8 @@
 // Copyright (c) 2013-2019 Bluespec, Inc. All Rights Reserved
 
-// This program reads an ELF file into an in-memory byte-array.
-// This can then sent to a debugger.
+// This program reads an ELF file into a sparse in-memory image
+// (4KB pages, materialized only where the ELF file has contents), and
+// writes out the populated ranges as a Mem-hex32 file.
 
 // ================================================================
 // Standard C includes
@@ -17,8 +18,10 @@
 // ================================================================
 // Features of the ELF binary
 
+typedef struct Sparse_Mem Sparse_Mem;
+
 typedef struct {
-    uint8_t  *mem_buf;
+    Sparse_Mem *p_mem;
     int       bitwidth;
     uint64_t  min_addr;
     uint64_t  max_addr;
@@ -35,12 +38,145 @@ typedef struct {
 #define  RESULT_ERR  1
 
 // ================================================================
-// Memory buffer into which we load the ELF file.
+// Sparse memory image into which we load the ELF file.
+// A hash table (chained, resized as it fills) of 4KB pages, each
+// allocated (zeroed) on first touch.  Each page remembers the range
+// of bytes written into it, so that only those are output.
+
+#define PAGE_SIZE_LOG2  12
+#define PAGE_SIZE       ((uint64_t) 1 << PAGE_SIZE_LOG2)
+
+typedef struct Page {
+    struct Page  *next;       // hash chain
+    uint64_t      page_num;   // addr >> PAGE_SIZE_LOG2
+    uint32_t      lo, hi;     // byte offsets [lo, hi) written in this page
+    uint8_t       data [PAGE_SIZE];
+} Page;
+
+struct Sparse_Mem {
+    uint64_t   n_buckets_log2;
+    uint64_t   n_pages;
+    Page     **buckets;
+};
+
+static Sparse_Mem  mem;
+
+static
+uint64_t sparse_mem_hash (uint64_t page_num, uint64_t n_buckets_log2)
+{
+    return ((page_num * 0x9E3779B97F4A7C15llu) >> (64 - n_buckets_log2));
+}
+
+static
+void sparse_mem_init (Sparse_Mem *p_mem)
+{
+    p_mem->n_buckets_log2 = 8;
+    p_mem->n_pages        = 0;
+    p_mem->buckets        = (Page **) calloc ((uint64_t) 1 << p_mem->n_buckets_log2, sizeof (Page *));
+    if (p_mem->buckets == NULL) {
+	fprintf (stdout, "ERROR: sparse_mem_init: unable to allocate hash table\n");
+	exit (1);
+    }
+}
+
+static
+void sparse_mem_grow (Sparse_Mem *p_mem)
+{
+    uint64_t  new_log2    = p_mem->n_buckets_log2 + 1;
+    Page    **new_buckets = (Page **) calloc ((uint64_t) 1 << new_log2, sizeof (Page *));
+    if (new_buckets == NULL) {
+	fprintf (stdout, "ERROR: sparse_mem_grow: unable to allocate hash table\n");
+	exit (1);
+    }
+    for (uint64_t j = 0; j < ((uint64_t) 1 << p_mem->n_buckets_log2); j++) {
+	Page *p_page = p_mem->buckets [j];
+	while (p_page != NULL) {
+	    Page     *p_next = p_page->next;
+	    uint64_t  h      = sparse_mem_hash (p_page->page_num, new_log2);
+	    p_page->next     = new_buckets [h];
+	    new_buckets [h]  = p_page;
+	    p_page = p_next;
+	}
+    }
+    free (p_mem->buckets);
+    p_mem->buckets        = new_buckets;
+    p_mem->n_buckets_log2 = new_log2;
+}
+
+// Return the page for page_num, allocating it if new
+static
+Page *sparse_mem_page (Sparse_Mem *p_mem, uint64_t page_num)
+{
+    uint64_t h = sparse_mem_hash (page_num, p_mem->n_buckets_log2);
+    for (Page *p_page = p_mem->buckets [h]; p_page != NULL; p_page = p_page->next)
+	if (p_page->page_num == page_num)
+	    return p_page;
+
+    if (p_mem->n_pages >= ((uint64_t) 1 << p_mem->n_buckets_log2)) {
+	sparse_mem_grow (p_mem);
+	h = sparse_mem_hash (page_num, p_mem->n_buckets_log2);
+    }
+
+    Page *p_page = (Page *) calloc (1, sizeof (Page));
+    if (p_page == NULL) {
+	fprintf (stdout, "ERROR: sparse_mem_page: unable to allocate page\n");
+	exit (1);
+    }
+    p_page->page_num = page_num;
+    p_page->lo       = PAGE_SIZE;
+    p_page->hi       = 0;
+    p_page->next     = p_mem->buckets [h];
+    p_mem->buckets [h] = p_page;
+    p_mem->n_pages++;
+    return p_page;
+}
 
-// Supports addrs from 0..4GB
-#define MAX_MEM_SIZE ((uint64_t) 0x100000000)
+// Write size bytes from src (zeroes if src is NULL) at addr
+static
+void sparse_mem_write (Sparse_Mem *p_mem, uint64_t addr, const uint8_t *src, uint64_t size)
+{
+    while (size != 0) {
+	Page     *p_page = sparse_mem_page (p_mem, addr >> PAGE_SIZE_LOG2);
+	uint32_t  offset = addr & (PAGE_SIZE - 1);
+	uint64_t  n      = PAGE_SIZE - offset;
+	if (n > size) n = size;
+
+	if (src != NULL) {
+	    memcpy (& (p_page->data [offset]), src, n);
+	    src += n;
+	}
+	if (offset < p_page->lo)         p_page->lo = offset;
+	if (p_page->hi < (offset + n))   p_page->hi = offset + n;
 
-static uint8_t mem_buf [MAX_MEM_SIZE];
+	addr += n;
+	size -= n;
+    }
+}
+
+static
+int page_cmp (const void *p1, const void *p2)
+{
+    uint64_t n1 = (* (Page **) p1)->page_num;
+    uint64_t n2 = (* (Page **) p2)->page_num;
+    return ((n1 < n2) ? -1 : ((n1 > n2) ? 1 : 0));
+}
+
+// Return an array of the pages, sorted by page_num
+static
+Page **sparse_mem_sorted_pages (Sparse_Mem *p_mem)
+{
+    Page **pages = (Page **) malloc ((p_mem->n_pages + 1) * sizeof (Page *));
+    if (pages == NULL) {
+	fprintf (stdout, "ERROR: sparse_mem_sorted_pages: unable to allocate\n");
+	exit (1);
+    }
+    uint64_t k = 0;
+    for (uint64_t j = 0; j < ((uint64_t) 1 << p_mem->n_buckets_log2); j++)
+	for (Page *p_page = p_mem->buckets [j]; p_page != NULL; p_page = p_page->next)
+	    pages [k++] = p_page;
+    qsort (pages, p_mem->n_pages, sizeof (Page *), page_cmp);
+    return pages;
+}
 
 // ================================================================
 // Load an ELF file.
@@ -181,23 +317,13 @@ int c_mem_load_elf (const char    *elf_filename,
 	    if (p_features->max_addr < (shdr.sh_addr + data->d_size - 1))   // shdr.sh_size + 4))
 		p_features->max_addr = shdr.sh_addr + data->d_size - 1;    // shdr.sh_size + 4;
 
-	    if (p_features->max_addr >= MAX_MEM_SIZE) {
-		fprintf (stdout,
-			 "INTERNAL ERROR: addr 0x%0" PRIx64 " in ELF file is too large.\n",
-			 p_features->max_addr);
-		fprintf (stdout,
-			 "    This program has: #define MAX_MEM_SIZE  0x%0" PRIx64 "\n",
-			 MAX_MEM_SIZE);
-		fprintf (stdout,
-			 "    Please increase this, recompile, and re-run\n");
-		return RESULT_ERR;
-	    }
-
-	    if (shdr.sh_type != SHT_NOBITS) {
-		memcpy (& (mem_buf [shdr.sh_addr]), data->d_buf, data->d_size);
-	    }
-	    fprintf (stdout, "addr %16" PRIx64 " to addr %16" PRIx64 "; size 0x%8lx (= %0ld) bytes\n",
-		     shdr.sh_addr, shdr.sh_addr + data->d_size, data->d_size, data->d_size);
+	    // NOBITS sections (.bss) are written as zeroes
+	    sparse_mem_write (& mem, shdr.sh_addr,
+			      ((shdr.sh_type == SHT_NOBITS) ? NULL : data->d_buf),
+			      data->d_size);
+	    fprintf (stdout, "addr %16" PRIx64 " to addr %16" PRIx64 "; size 0x%8" PRIx64 " (= %0" PRId64 ") bytes\n",
+		     shdr.sh_addr, shdr.sh_addr + data->d_size,
+		     (uint64_t) data->d_size, (uint64_t) data->d_size);
 	}
 
 	// If we find the symbol table, search for symbols of interest
@@ -262,7 +388,7 @@ int c_mem_load_elf (const char    *elf_filename,
 
     elf_end (e);
 
-    p_features->mem_buf = & (mem_buf [0]);
+    p_features->p_mem = & mem;
 
     fprintf (stdout, "Min addr:            %16" PRIx64 " (hex)\n", p_features->min_addr);
     fprintf (stdout, "Max addr:            %16" PRIx64 " (hex)\n", p_features->max_addr);
@@ -275,8 +401,8 @@ int c_mem_load_elf (const char    *elf_filename,
 int elf_readfile (const  char   *elf_filename,
 		  Elf_Features  *p_features)
 {
-    // Zero out the memory buffer before loading the ELF file
-    bzero (mem_buf, MAX_MEM_SIZE);
+    // Start with an empty sparse memory (no pages)
+    sparse_mem_init (& mem);
 
     return c_mem_load_elf (elf_filename, "_start", "exit", "tohost", p_features);
 }
@@ -296,8 +422,8 @@ int main (int argc, char *argv [])
     if (retcode != 0)
 	return 1;
 
-    fprintf (stdout, "min_addr = %0lx\n", elf_features.min_addr);
-    fprintf (stdout, "max_addr = %0lx\n", elf_features.max_addr);
+    fprintf (stdout, "min_addr = %0" PRIx64 "\n", elf_features.min_addr);
+    fprintf (stdout, "max_addr = %0" PRIx64 "\n", elf_features.max_addr);
 
     fprintf (stdout, "Writing memhex file: %s\n", argv [2]);
     FILE *fout = fopen (argv [2], "w");
@@ -306,11 +432,26 @@ int main (int argc, char *argv [])
 	return 1;
     }
 
-    fprintf (fout, "@%0lx\n", elf_features.min_addr);
-    for (uint64_t addr = elf_features.min_addr; addr < elf_features.max_addr; addr += 4) {
-	uint32_t *p = (uint32_t *) (elf_features.mem_buf + addr);
-	fprintf (fout, "%08x\n", *p);
+    // Write only the populated ranges, with an '@addr' line wherever
+    // the next word is not contiguous with the previous one.
+    Page     **pages     = sparse_mem_sorted_pages (elf_features.p_mem);
+    uint64_t   next_addr = 0xFFFFFFFFFFFFFFFFllu;
+    for (uint64_t j = 0; j < elf_features.p_mem->n_pages; j++) {
+	Page     *p_page = pages [j];
+	uint64_t  base   = p_page->page_num << PAGE_SIZE_LOG2;
+	uint32_t  lo     = p_page->lo & (~ 0x3u);
+	uint32_t  hi     = (p_page->hi + 3) & (~ 0x3u);
+	if (lo >= hi) continue;
+
+	if ((base + lo) != next_addr)
+	    fprintf (fout, "@%0" PRIx64 "\n", base + lo);
+	for (uint32_t offset = lo; offset < hi; offset += 4) {
+	    uint32_t *p = (uint32_t *) (& (p_page->data [offset]));
+	    fprintf (fout, "%08" PRIx32 "\n", *p);
+	}
+	next_addr = base + hi;
     }
+    free (pages);
     fclose (fout);
     fprintf (stdout, "Memhex file written: %s\n", argv [2]);
 
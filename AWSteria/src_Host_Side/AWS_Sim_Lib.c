@@ -8,6 +8,8 @@
 #include "Bytevec.h"
 #include "AWS_Sim_Lib.h"
 #include "TCP_Client_Lib.h"
+#include "SHM_Client_Lib.h"
+#include "SHM_Ring.h"
 
 // ================================================================
 // Misc. constants
@@ -27,6 +29,42 @@ static uint16_t  default_port           = 30000;
 static
 Bytevec_state *p_bytevec_state = NULL;
 
+// ================================================================
+// Transport to the simulation server.
+// TCP by default; shared-memory rings if env var AWSTERIA_SHM names a
+// segment (the simulation must be run with the same AWSTERIA_SHM).
+
+static bool use_shm = false;
+
+static
+uint32_t comms_send (const uint32_t data_size, const char *data)
+{
+    if (use_shm)
+	return shm_client_send (data_size, data);
+    else
+	return tcp_client_send (data_size, data);
+}
+
+static
+uint32_t comms_wait (int timeout_ms)
+{
+    if (use_shm)
+	return shm_client_wait (timeout_ms);
+    else
+	return tcp_client_wait (timeout_ms);
+}
+
+static
+uint32_t comms_recv_avail (const uint32_t max_size, char *data, uint32_t *p_n_recd)
+{
+    if (use_shm)
+	return shm_client_recv_avail (max_size, data, p_n_recd);
+    else
+	return tcp_client_recv_avail (max_size, data, p_n_recd);
+}
+
+// ================================================================
+
 void AWS_Sim_Lib_init (void)
 {
     fprintf (stdout, "AWS_Sim_Lib_init()\n");
@@ -41,10 +79,23 @@ void AWS_Sim_Lib_init (void)
 	exit (1);
     }
 
-    uint32_t status = tcp_client_open (default_hostname, default_port);
-    if (status == status_err) {
-	fprintf (stdout, "ERROR: tcp_client_open() failed\n");
-	exit (1);
+    char *shm_name = getenv (SHM_ENV_VAR);
+    use_shm = (shm_name != NULL);
+
+    uint32_t status;
+    if (use_shm) {
+	status = shm_client_open (shm_name);
+	if (status == status_err) {
+	    fprintf (stdout, "ERROR: shm_client_open() failed\n");
+	    exit (1);
+	}
+    }
+    else {
+	status = tcp_client_open (default_hostname, default_port);
+	if (status == status_err) {
+	    fprintf (stdout, "ERROR: tcp_client_open() failed\n");
+	    exit (1);
+	}
     }
 
     fprintf (stdout, "AWS_Sim_Lib_init: initialized, connected to simulation server\n");
@@ -58,12 +109,20 @@ void check_state_initialized (void)
 
 void AWS_Sim_Lib_shutdown (void)
 {
-    fprintf (stdout, "AWS_Sim_Lib_shutdown: closing TCP connection\n");
-    tcp_client_close (0);
+    if (use_shm) {
+	fprintf (stdout, "AWS_Sim_Lib_shutdown: closing shared-memory connection\n");
+	shm_client_close (0);
+    }
+    else {
+	fprintf (stdout, "AWS_Sim_Lib_shutdown: closing TCP connection\n");
+	tcp_client_close (0);
+    }
 }
 
 // ================================================================
 
+static void dma_collect_responses (void);
+
 static
 bool do_comms (void)
 {
@@ -74,47 +133,47 @@ bool do_comms (void)
     uint32_t  status;
     bool activity = false;
 
-    // Send
+    // Send all ready packets in one batch
     if (verbosity2 > 1)
-	fprintf (stdout, "do_comms: packet to_bytevec\n");
-    int ready = Bytevec_struct_to_bytevec (p_bytevec_state);
-    if (ready) {
+	fprintf (stdout, "do_comms: packet to_bytevec_batch\n");
+    int n_bytes = Bytevec_struct_to_bytevec_batch (p_bytevec_state);
+    if (n_bytes != 0) {
 	if (verbosity2 != 0) {
-	    fprintf (stdout, "do_comms: sending %0d bytes\n  ", p_bytevec_state->bytevec_C_to_BSV [0]);
-	    for (int j = 0; j < p_bytevec_state->bytevec_C_to_BSV [0]; j++)
-		fprintf (stdout, " %02x", p_bytevec_state->bytevec_C_to_BSV [j]);
+	    fprintf (stdout, "do_comms: sending %0d bytes\n  ", n_bytes);
+	    for (int j = 0; j < n_bytes; j++)
+		fprintf (stdout, " %02x", p_bytevec_state->bytevec_C_to_BSV_batch [j]);
 	    fprintf (stdout, "\n");
 	}
-	status = tcp_client_send (p_bytevec_state->bytevec_C_to_BSV [0],
-				  p_bytevec_state->bytevec_C_to_BSV);
+	status = comms_send (n_bytes, (char *) p_bytevec_state->bytevec_C_to_BSV_batch);
 	if (status == 0) {
-	    fprintf (stdout, "do_comms: tcp_client_send error\n");
+	    fprintf (stdout, "do_comms: comms_send error\n");
 	    exit (1);
 	}
 
 	activity = true;
     }
         
-    // Receive
+    // Receive all available packets (the last one may be partial) and decode them
     if (verbosity2 > 1)
-	fprintf (stdout, "do_comms: attempt receive bytevec\n");
-    const bool poll    = true;
-    status = tcp_client_recv (poll, 1, p_bytevec_state->bytevec_BSV_to_C);
+	fprintf (stdout, "do_comms: attempt receive bytevecs\n");
+    uint32_t  n_have = p_bytevec_state->bytevec_BSV_to_C_batch_size;
+    uint32_t  n_recd = 0;
+    status = comms_recv_avail (BSV_TO_C_BATCH_BYTES - n_have,
+			       (char *) & (p_bytevec_state->bytevec_BSV_to_C_batch [n_have]),
+			       & n_recd);
     if (status == status_ok) {
-	const bool no_poll = false;
-	uint32_t size = p_bytevec_state->bytevec_BSV_to_C [0] - 1;
-	status = tcp_client_recv (no_poll, size, & (p_bytevec_state->bytevec_BSV_to_C [1]));
-
 	if (verbosity2 != 0) {
-	    fprintf (stdout, "do_comms: received %0d bytes\n  ", p_bytevec_state->bytevec_BSV_to_C [0]);
-	    for (int j = 0; j < p_bytevec_state->bytevec_BSV_to_C [0]; j++)
-		fprintf (stdout, " %02x", p_bytevec_state->bytevec_BSV_to_C [j]);
+	    fprintf (stdout, "do_comms: received %0d bytes\n  ", n_recd);
+	    for (int j = 0; j < n_recd; j++)
+		fprintf (stdout, " %02x", p_bytevec_state->bytevec_BSV_to_C_batch [n_have + j]);
 	    fprintf (stdout, "\n");
 	}
+	p_bytevec_state->bytevec_BSV_to_C_batch_size = n_have + n_recd;
 
 	if (verbosity2 != 0)
-	    fprintf (stdout, "do_comms: packet from_bytevec\n");
-	Bytevec_struct_from_bytevec (p_bytevec_state);
+	    fprintf (stdout, "do_comms: packets from_bytevec_batch\n");
+	Bytevec_struct_from_bytevec_batch (p_bytevec_state);
+	dma_collect_responses ();
 
 	activity = true;
     }
@@ -122,29 +181,196 @@ bool do_comms (void)
 }
 
 // ================================================================
+// Do comms and, if nothing happened, wait for the simulation.
+// Adaptive spin-then-block: first retry do_comms() up to spin_limit
+// times, then block on the transport until input arrives (with a
+// timeout, just to re-check).  spin_limit grows when responses tend
+// to arrive while spinning, and shrinks when we end up blocking.
+// Only TCP truly blocks (poll () on the socket), so its wake-up latency
+// is bounded by the simulation.  Shared memory has no kernel object to
+// block on: shm_client_wait () yields and then sleeps with backoff, so
+// a response can still wait up to 1 ms to be noticed.
+
+#define SPIN_LIMIT_MIN    16
+#define SPIN_LIMIT_MAX    4096
+#define WAIT_TIMEOUT_MS   100
+
+static uint32_t spin_limit = SPIN_LIMIT_MIN;
+static uint32_t n_spins    = 0;
 
-int fpga_dma_burst_read (int fd, uint8_t *buffer, size_t size, uint64_t address)
+static
+void do_comms_or_wait (void)
+{
+    if (do_comms ()) {
+	if ((n_spins != 0) && (spin_limit < SPIN_LIMIT_MAX))
+	    spin_limit = spin_limit * 2;
+	n_spins = 0;
+	return;
+    }
+
+    if (n_spins < spin_limit) {
+	n_spins++;
+	return;
+    }
+
+    if (spin_limit > SPIN_LIMIT_MIN)
+	spin_limit = spin_limit / 2;
+    n_spins = 0;
+    if (comms_wait (WAIT_TIMEOUT_MS) == status_err) {
+	fprintf (stdout, "do_comms: the simulation has exited\n");
+	exit (1);
+    }
+}
+
+// ================================================================
+// Outstanding DMA bursts
+
+// Each outstanding burst occupies a slot; the slot index is also the
+// AXI4 awid/arid of the burst, so responses are matched to slots by
+// bid/rid.  Handles returned to the caller are the write slot index
+// (0..DMA_MAX_OUTSTANDING-1) or DMA_MAX_OUTSTANDING + the read slot index.
+
+#define DMA_MAX_OUTSTANDING  16
+
+typedef enum { DMA_SLOT_FREE, DMA_SLOT_PENDING, DMA_SLOT_DONE } DMA_Slot_State;
+
+typedef struct {
+    DMA_Slot_State  state;
+    uint8_t        *buffer;       // reads: destination of rdata
+    uint64_t        address;      // reads: address of buffer [0]
+    uint64_t        size;         // reads: # of bytes in buffer
+    uint64_t        num_beats;
+    uint64_t        beats_done;   // reads: # of rdata beats received
+    bool            err;          // error response, or protocol error
+} DMA_Slot;
+
+static DMA_Slot  dma_wr_slots [DMA_MAX_OUTSTANDING];
+static DMA_Slot  dma_rd_slots [DMA_MAX_OUTSTANDING];
+
+// ----------------------------------------------------------------
+// Retrieve DMA responses from the Bytevec state and record them in
+// their slots.  Called by do_comms() whenever it receives bytevecs.
+
+static
+void dma_collect_responses (void)
 {
     int  verbosity2 = 0;
-    bool tcp_activity;
 
-    check_state_initialized ();
+    AXI4_Wr_Resp_i16_u0  wrr;
+    while (Bytevec_dequeue_AXI4_Wr_Resp_i16_u0 (p_bytevec_state, & wrr) == 1) {
+	DMA_Slot *p_slot = & (dma_wr_slots [wrr.bid % DMA_MAX_OUTSTANDING]);
+	if ((wrr.bid >= DMA_MAX_OUTSTANDING) || (p_slot->state != DMA_SLOT_PENDING)) {
+	    fprintf (stdout, "ERROR: dma_collect_responses: unexpected bid %0d\n", wrr.bid);
+	    continue;
+	}
+	if (verbosity2 != 0)
+	    fprintf (stdout, "dma_collect_responses: bid %0d bresp %0d\n", wrr.bid, wrr.bresp);
+	p_slot->err   = (p_slot->err || (wrr.bresp != 0));    // AXI4: bresp is OKAY
+	p_slot->state = DMA_SLOT_DONE;
+    }
+
+    AXI4_Rd_Data_i16_d512_u0  rdd;
+    while (Bytevec_dequeue_AXI4_Rd_Data_i16_d512_u0 (p_bytevec_state, & rdd) == 1) {
+	DMA_Slot *p_slot = & (dma_rd_slots [rdd.rid % DMA_MAX_OUTSTANDING]);
+	if ((rdd.rid >= DMA_MAX_OUTSTANDING) || (p_slot->state != DMA_SLOT_PENDING)) {
+	    fprintf (stdout, "ERROR: dma_collect_responses: unexpected rid %0d\n", rdd.rid);
+	    continue;
+	}
+
+	// Debugging: show response
+	if (verbosity2 != 0) {
+	    fprintf (stdout, "dma_collect_responses: rid %0d beat %0ld  rresp %0d  rlast %0d  rdata:\n  [",
+		     rdd.rid, p_slot->beats_done, rdd.rresp, rdd.rlast);
+	    for (int k = 0; k < 64; k++)
+		fprintf (stdout, " %02x", rdd.rdata [k]);
+	    fprintf (stdout, "]\n");
+	}
+
+	// Check rlast was properly set
+	bool last_beat = (p_slot->beats_done == (p_slot->num_beats - 1));
+	if (rdd.rlast != last_beat) {
+	    fprintf (stdout, "ERROR: dma_collect_responses: rid %0d: rlast is %0d on beat %0ld of %0ld\n",
+		     rdd.rid, rdd.rlast, p_slot->beats_done, p_slot->num_beats);
+	    p_slot->err = true;
+	}
+	p_slot->err = (p_slot->err || (rdd.rresp != 0));    // AXI4: rresp is OKAY
+
+	// Copy the part of the beat that lies within [address, address+size)
+	uint64_t beat_addr = (p_slot->address & align_mask_64B) + (p_slot->beats_done * 64);
+	uint64_t lo = ((beat_addr < p_slot->address) ? p_slot->address : beat_addr);
+	uint64_t hi = (((beat_addr + 64) > (p_slot->address + p_slot->size))
+		       ? (p_slot->address + p_slot->size)
+		       : (beat_addr + 64));
+	if (lo < hi)
+	    memcpy (p_slot->buffer + (lo - p_slot->address), & (rdd.rdata [lo - beat_addr]), hi - lo);
+	p_slot->beats_done += 1;
+	if (rdd.rlast || (p_slot->beats_done == p_slot->num_beats))
+	    p_slot->state = DMA_SLOT_DONE;
+    }
+}
+
+// ----------------------------------------------------------------
+// Allocate a free slot, waiting for outstanding bursts if necessary.
+// Completed slots only become free when their handle is polled or
+// waited on, so if every slot is completed-but-unclaimed, fail.
+
+static
+int dma_alloc_slot (DMA_Slot *slots, const char *fn_name)
+{
+    while (true) {
+	bool any_pending = false;
+	for (int j = 0; j < DMA_MAX_OUTSTANDING; j++) {
+	    if (slots [j].state == DMA_SLOT_FREE)
+		return j;
+	    any_pending = (any_pending || (slots [j].state == DMA_SLOT_PENDING));
+	}
+	if (! any_pending) {
+	    fprintf (stdout, "ERROR: %s: all %0d handles are complete but not yet polled/waited\n",
+		     fn_name, DMA_MAX_OUTSTANDING);
+	    return -1;
+	}
+	do_comms_or_wait ();
+    }
+}
+
+// ----------------------------------------------------------------
+// Check burst args; return 0 if ok, 1 if error
+// Any address and size are ok as long as the burst stays within a 4KB
+// page; partial first/last beats are handled with wstrb (writes) or by
+// copying only the requested bytes (reads).
+
+static
+int dma_check_burst (const char *fn_name, size_t size, uint64_t address)
+{
+    if (size == 0) {
+	fprintf (stdout, "ERROR: %s: size is 0\n", fn_name);
+	return 1;
+    }
 
     // Check that the buffer does not cross a 4K boundary (= 12 bits of LSBs)
     uint64_t  address_lim = address + size;
     if ((address >> 12) != ((address_lim - 1) >> 12)) {
-	fprintf (stdout, "ERROR: fpga_dma_burst_write: buffer crosses a 4K boundary\n");
+	fprintf (stdout, "ERROR: %s: buffer crosses a 4K boundary\n", fn_name);
 	fprintf (stdout, "    Start address: %16lx\n", address);
 	fprintf (stdout, "    Last  address: %16lx\n", (address_lim - 1));
 	return 1;
     }
+    return 0;
+}
 
-    // Check that address is 64-Byte aligned (TODO: temporary; relax this)
-    if ((address & 0x3F) != 0) {
-	fprintf (stdout, "ERROR: fpga_dma_burst_write: address is not 64-byte aligned\n");
-	fprintf (stdout, "    Start address: %16lx\n", address);
-	return 1;
-    }
+// ----------------------------------------------------------------
+// Submit a burst read of 'size' bytes at any 'address', within a 4KB
+// page; returns handle, or -1 if error.
+// Only the requested bytes of the first and last beats are stored.
+
+static
+int dma_read_submit (const char *fn_name, uint8_t *buffer, size_t size, uint64_t address)
+{
+    int  verbosity2 = 0;
+
+    int id = dma_alloc_slot (dma_rd_slots, fn_name);
+    if (id < 0)
+	return -1;
 
     // ----------------
     // Send RD_ADDR bus request
@@ -152,7 +378,7 @@ int fpga_dma_burst_read (int fd, uint8_t *buffer, size_t size, uint64_t address)
     AXI4_Rd_Addr_i16_a64_u0   rda;
 
     // TODO: Check if these defaults are ok
-    rda.arid     = 0;
+    rda.arid     = id;
     rda.arlock   = 0;    // "normal"
     rda.arcache  = 0;    // "dev_nonbuf"
     rda.arprot   = 0;    // { data, secure, unpriv }
@@ -161,101 +387,63 @@ int fpga_dma_burst_read (int fd, uint8_t *buffer, size_t size, uint64_t address)
     rda.aruser   = 0;
 
     // Compute burst length (each beat on DMA PCIS is 64 bytes = 6 bits of LSBs)
+    uint64_t  address_lim = address + size;
     uint64_t  num_beats = ((address_lim - 1) >> 6) - (address >> 6) + 1;
 
-    rda.araddr  = address;
+    rda.araddr  = (address & align_mask_64B);
     rda.arlen   = num_beats - 1;    // AXI4 code: awlen+1 beats
     rda.arsize  = 0x6;              // AXI4 code: 64 bytes
     rda.arburst = 0x1;              // AXI4 code: 'incrementing' burst
 
+    DMA_Slot *p_slot   = & (dma_rd_slots [id]);
+    p_slot->state      = DMA_SLOT_PENDING;
+    p_slot->buffer     = buffer;
+    p_slot->address    = address;
+    p_slot->size       = size;
+    p_slot->num_beats  = num_beats;
+    p_slot->beats_done = 0;
+    p_slot->err        = false;
+
     if (verbosity2 != 0)
-	fprintf (stdout, "fpga_dma_burst_read: araddr %0lx arlen %0d arsize %0x arburst %0x",
-		 rda.araddr, rda.arlen, rda.arsize, rda.arburst);
+	fprintf (stdout, "%s: arid %0d araddr %0lx arlen %0d arsize %0x arburst %0x\n",
+		 fn_name, rda.arid, rda.araddr, rda.arlen, rda.arsize, rda.arburst);
     while (true) {
 	int status = Bytevec_enqueue_AXI4_Rd_Addr_i16_a64_u0 (p_bytevec_state, & rda);
 	if (status == 1) break;
-	usleep (1);
-	tcp_activity = do_comms ();
+	do_comms_or_wait ();
     }
-    tcp_activity = do_comms ();
-
-    // ----------------
-    // Read RD_DATA bus burst response
-
-    AXI4_Rd_Data_i16_d512_u0  rdd;
+    do_comms ();
 
-    uint8_t *pb = buffer;
-
-    bool ok = true;
-    for (int beat = 0; beat < num_beats; beat++) {
-	while (true) {
-	    tcp_activity = do_comms ();
-	    if (! tcp_activity)
-		usleep (1);
-
-	    int status = Bytevec_dequeue_AXI4_Rd_Data_i16_d512_u0 (p_bytevec_state, & rdd);
-	    if (status == 1) break;
-
-	    if (verbosity2 > 1)
-		fprintf (stdout, "fpga_dma_burst_read: response polling loop; beat %0d\n", beat);
-	}
+    return DMA_MAX_OUTSTANDING + id;
+}
 
-	// Debugging: show response
-	if (verbosity2 != 0) {
-	    fprintf (stdout, "fpga_dma_burst_read: beat %0d  rresp %0d  rlast %0d  rdata:\n  [",
-		     beat, rdd.rresp, rdd.rlast);
-	    for (int k = 0; k < 64; k++)
-		fprintf (stdout, " %02x", rdd.rdata [k]);
-	    fprintf (stdout, "]\n");
-	}
+// ================================================================
+// Asynchronous DMA: submit a burst read; returns handle, or -1 if error.
+// 'buffer' must remain valid until the handle has completed.
 
-	// Check rlast was properly set
-	if (beat == (num_beats - 1)) {
-	    if (rdd.rlast == 0) {
-		fprintf (stdout, "ERROR: fpga_dma_burst_read: rlast is 0 on last beat\n");
-		return 1;
-	    }
-	}
-	else {
-	    if (rdd.rlast == 1) {
-		fprintf (stdout, "ERROR: fpga_dma_burst_read: rlast is 1 on non-last beat\n");
-		return 1;
-	    }
-	}
-	ok = (ok && (rdd.rresp == 0));    // AXI4: rresp is OKAY
+int fpga_dma_burst_read_submit (int fd, uint8_t *buffer, size_t size, uint64_t address)
+{
+    check_state_initialized ();
 
-	memcpy (pb, & (rdd.rdata), 64);
-	pb += 64;
-    }    
-    fprintf (stdout, "fpga_dma_burst_read complete\n");
+    if (dma_check_burst ("fpga_dma_burst_read_submit", size, address) != 0)
+	return -1;
 
-    return (! ok);
+    return dma_read_submit ("fpga_dma_burst_read_submit", buffer, size, address);
 }
 
-// ================================================================
+// ----------------------------------------------------------------
+// Submit a burst write of 'size' bytes at any 'address', within a 4KB
+// page; returns handle, or -1 if error.
+// wstrb enables only the bytes being written in the first and last beats.
 
-int fpga_dma_burst_write (int fd, uint8_t *buffer, size_t size, uint64_t address)
+static
+int dma_write_submit (const char *fn_name, uint8_t *buffer, size_t size, uint64_t address)
 {
     int  verbosity2 = 0;
-    bool tcp_activity;
-
-    check_state_initialized ();
 
-    // Check that the buffer does not cross a 4K boundary (= 12 bits of LSBs)
-    uint64_t  address_lim = address + size;
-    if ((address >> 12) != ((address_lim - 1) >> 12)) {
-	fprintf (stdout, "ERROR: fpga_dma_burst_write: buffer crosses a 4K boundary\n");
-	fprintf (stdout, "    Start address: %16lx\n", address);
-	fprintf (stdout, "    Last  address: %16lx\n", (address_lim - 1));
-	return 1;
-    }
-
-    // Check that address is 64-Byte aligned (TODO: temporary; relax this)
-    if ((address & 0x3F) != 0) {
-	fprintf (stdout, "ERROR: fpga_dma_burst_write: address is not 64-byte aligned\n");
-	fprintf (stdout, "    Start address: %16lx\n", address);
-	return 1;
-    }
+    int id = dma_alloc_slot (dma_wr_slots, fn_name);
+    if (id < 0)
+	return -1;
 
     // ----------------
     // Send WR_ADDR bus request
@@ -263,7 +451,7 @@ int fpga_dma_burst_write (int fd, uint8_t *buffer, size_t size, uint64_t address
     AXI4_Wr_Addr_i16_a64_u0  wra;
 
     // TODO: Check if these defaults are ok
-    wra.awid     = 0;
+    wra.awid     = id;
     wra.awlock   = 0;    // "normal"
     wra.awcache  = 0;    // "dev_nonbuf"
     wra.awprot   = 0;    // { data, secure, unpriv }
@@ -272,40 +460,53 @@ int fpga_dma_burst_write (int fd, uint8_t *buffer, size_t size, uint64_t address
     wra.awuser   = 0;
 
     // Compute burst length (each beat on DMA PCIS is 64 bytes = 6 bits of LSBs)
+    uint64_t  address_lim = address + size;
     uint64_t  num_beats = ((address_lim - 1) >> 6) - (address >> 6) + 1;
 
-    wra.awaddr  = address;
+    wra.awaddr  = (address & align_mask_64B);
     wra.awlen   = num_beats - 1;    // AXI4 code: awlen+1 beats
     wra.awsize  = 0x6;              // AXI4 code: 64 bytes
     wra.awburst = 0x1;              // AXI4 code: 'incrementing' burst
 
+    DMA_Slot *p_slot   = & (dma_wr_slots [id]);
+    p_slot->state      = DMA_SLOT_PENDING;
+    p_slot->buffer     = NULL;
+    p_slot->num_beats  = num_beats;
+    p_slot->beats_done = 0;
+    p_slot->err        = false;
+
     if (verbosity2 != 0)
-	fprintf (stdout, "fpga_dma_burst_write: awaddr %0lx awlen %0d awsize %0x awburst %0x\n",
-		 wra.awaddr, wra.awlen, wra.awsize, wra.awburst);
+	fprintf (stdout, "%s: awid %0d awaddr %0lx awlen %0d awsize %0x awburst %0x\n",
+		 fn_name, wra.awid, wra.awaddr, wra.awlen, wra.awsize, wra.awburst);
     while (true) {
 	int status = Bytevec_enqueue_AXI4_Wr_Addr_i16_a64_u0 (p_bytevec_state, & wra);
 	if (status == 1) break;
-	usleep (1);
-	tcp_activity = do_comms ();
+	do_comms_or_wait ();
     }
-    tcp_activity = do_comms ();
 
     // ----------------
     // Send WR_DATA bus request
 
     AXI4_Wr_Data_d512_u0  wrd;
     wrd.wuser = 0;
-    wrd.wstrb = 0xFFFFffffFFFFffff;    // TODO: adjust for first and last beat
 
-    uint8_t *pb = buffer;
+    uint64_t  beat_addr = (address & align_mask_64B);
 
     for (int beat = 0; beat < num_beats; beat++) {
-	memcpy (& wrd.wdata, pb, 64);
+	// The part of the beat that lies within [address, address_lim)
+	uint64_t lo = ((beat_addr < address) ? address : beat_addr);
+	uint64_t hi = (((beat_addr + 64) > address_lim) ? address_lim : (beat_addr + 64));
+	uint64_t n  = hi - lo;
+
+	memset (& wrd.wdata, 0, 64);
+	memcpy (& (wrd.wdata [lo - beat_addr]), buffer + (lo - address), n);
+	wrd.wstrb = (((n == 64) ? 0xFFFFffffFFFFffff : ((((uint64_t) 1) << n) - 1))
+		     << (lo - beat_addr));
 	wrd.wlast = (beat == (num_beats - 1));
 
 	if (verbosity2 != 0) {
-	    fprintf (stdout, "fpga_dma_burst_write: beat %0d  wlast %0d  wdata:\n  ",
-		     beat, wrd.wlast);
+	    fprintf (stdout, "%s: beat %0d  wstrb %016lx  wlast %0d  wdata:\n  ",
+		     fn_name, beat, wrd.wstrb, wrd.wlast);
 	    for (int k = 0; k < 64; k++)
 		fprintf (stdout, " %02x", wrd.wdata [k]);
 	    fprintf (stdout, "\n");
@@ -314,34 +515,160 @@ int fpga_dma_burst_write (int fd, uint8_t *buffer, size_t size, uint64_t address
 	while (true) {
 	    int status = Bytevec_enqueue_AXI4_Wr_Data_d512_u0  (p_bytevec_state, & wrd);
 	    if (status == 1) break;
-	    usleep (1);
-	    tcp_activity = do_comms ();
+	    do_comms_or_wait ();
 	}
-	tcp_activity = do_comms ();
-	pb += 64;
+	beat_addr += 64;
     }    
+    do_comms ();
 
-    // ----------------
-    // Get  WR_RESP bus response
+    return id;
+}
 
-    AXI4_Wr_Resp_i16_u0  wrr;
+// ================================================================
+// Asynchronous DMA: submit a burst write; returns handle, or -1 if error.
+// The data is copied out of 'buffer' before this returns.
+
+int fpga_dma_burst_write_submit (int fd, uint8_t *buffer, size_t size, uint64_t address)
+{
+    check_state_initialized ();
+
+    if (dma_check_burst ("fpga_dma_burst_write_submit", size, address) != 0)
+	return -1;
 
+    return dma_write_submit ("fpga_dma_burst_write_submit", buffer, size, address);
+}
+
+// ================================================================
+// Asynchronous DMA: poll a handle.
+// Returns 0 if the burst is still in flight, or 1 if it has completed,
+// in which case *p_err is set (0: ok; 1: error response) and the
+// handle is released.  Returns -1 for an invalid handle.
+
+int fpga_dma_poll (int handle, int *p_err)
+{
+    check_state_initialized ();
+
+    DMA_Slot *p_slot;
+    if ((handle >= 0) && (handle < DMA_MAX_OUTSTANDING))
+	p_slot = & (dma_wr_slots [handle]);
+    else if ((handle >= DMA_MAX_OUTSTANDING) && (handle < (2 * DMA_MAX_OUTSTANDING)))
+	p_slot = & (dma_rd_slots [handle - DMA_MAX_OUTSTANDING]);
+    else {
+	fprintf (stdout, "ERROR: fpga_dma_poll: invalid handle %0d\n", handle);
+	return -1;
+    }
+
+    if (p_slot->state == DMA_SLOT_FREE) {
+	fprintf (stdout, "ERROR: fpga_dma_poll: handle %0d is not in use\n", handle);
+	return -1;
+    }
+
+    if (p_slot->state == DMA_SLOT_PENDING) {
+	do_comms ();
+	if (p_slot->state == DMA_SLOT_PENDING)
+	    return 0;
+    }
+
+    *p_err = p_slot->err;
+    p_slot->state = DMA_SLOT_FREE;
+    return 1;
+}
+
+// ================================================================
+// Asynchronous DMA: wait for a handle to complete and release it.
+// Returns 0 if ok, 1 if error.
+
+int fpga_dma_wait (int handle)
+{
+    int err = 1;
     while (true) {
-	tcp_activity = do_comms ();
-	if (! tcp_activity)
-	    usleep (1);
+	int done = fpga_dma_poll (handle, & err);
+	if (done < 0) return 1;
+	if (done == 1) break;
+	do_comms_or_wait ();
+    }
+    return err;
+}
 
-	int status = Bytevec_dequeue_AXI4_Wr_Resp_i16_u0 (p_bytevec_state, & wrr);
-	if (status == 1) break;
+// ================================================================
+// Synchronous burst read: submit and wait
 
-	if (verbosity2 > 1)
-	    fprintf (stdout, "fpga_dma_burst_write: response polling loop\n");
+int fpga_dma_burst_read (int fd, uint8_t *buffer, size_t size, uint64_t address)
+{
+    int handle = fpga_dma_burst_read_submit (fd, buffer, size, address);
+    if (handle < 0)
+	return 1;
+    return fpga_dma_wait (handle);
+}
+
+// ================================================================
+// Synchronous burst write: submit and wait
 
+int fpga_dma_burst_write (int fd, uint8_t *buffer, size_t size, uint64_t address)
+{
+    int handle = fpga_dma_burst_write_submit (fd, buffer, size, address);
+    if (handle < 0)
+	return 1;
+    return fpga_dma_wait (handle);
+}
+
+// ================================================================
+// Large transfers: any size, any alignment.
+// The transfer is split at 4KB boundaries (so each piece is a burst of
+// at most 64 beats), and up to DMA_MAX_OUTSTANDING bursts are kept in
+// flight at a time.  Returns 0 if ok, 1 if error.
+
+typedef int (*DMA_Submit_Fn) (const char *fn_name, uint8_t *buffer, size_t size, uint64_t address);
+
+static
+int dma_transfer (const char *fn_name, DMA_Submit_Fn submit_fn,
+		  uint8_t *buffer, size_t size, uint64_t address)
+{
+    check_state_initialized ();
+
+    int       handles [DMA_MAX_OUTSTANDING];
+    int       n_outstanding = 0;    // handles [0 .. n_outstanding-1], oldest first
+    int       err           = 0;
+    uint64_t  offset        = 0;
+
+    while (offset < size) {
+	uint64_t  addr1  = address + offset;
+	uint64_t  chunk  = ((addr1 & align_mask_4KB) + span_4KB) - addr1;
+	if (chunk > (size - offset))
+	    chunk = size - offset;
+
+	// Wait for the oldest burst if the pipeline is full
+	if (n_outstanding == DMA_MAX_OUTSTANDING) {
+	    err = (err | fpga_dma_wait (handles [0]));
+	    memmove (& (handles [0]), & (handles [1]), (DMA_MAX_OUTSTANDING - 1) * sizeof (int));
+	    n_outstanding--;
+	}
+
+	int handle = submit_fn (fn_name, buffer + offset, chunk, addr1);
+	if (handle < 0) {
+	    err = 1;
+	    break;
+	}
+	handles [n_outstanding] = handle;
+	n_outstanding++;
+	offset += chunk;
     }
-    if (verbosity2 != 0)
-	fprintf (stdout, "fpga_dma_burst_write: complete; bresp = %0d\n", wrr.bresp);
 
-    return (wrr.bresp != 0);
+    // Drain the pipeline
+    for (int j = 0; j < n_outstanding; j++)
+	err = (err | fpga_dma_wait (handles [j]));
+
+    return err;
+}
+
+int fpga_dma_write (int fd, uint8_t *buffer, size_t size, uint64_t address)
+{
+    return dma_transfer ("fpga_dma_write", dma_write_submit, buffer, size, address);
+}
+
+int fpga_dma_read (int fd, uint8_t *buffer, size_t size, uint64_t address)
+{
+    return dma_transfer ("fpga_dma_read", dma_read_submit, buffer, size, address);
 }
 
 // ================================================================
@@ -349,7 +676,6 @@ int fpga_dma_burst_write (int fd, uint8_t *buffer, size_t size, uint64_t address
 int fpga_pci_peek (uint32_t ocl_addr, uint32_t *p_ocl_data)
 {
     int  verbosity2 = 0;
-    bool tcp_activity;
 
     check_state_initialized ();
 
@@ -365,14 +691,11 @@ int fpga_pci_peek (uint32_t ocl_addr, uint32_t *p_ocl_data)
     while (true) {
 	int status = Bytevec_enqueue_AXI4L_Rd_Addr_a32_u0 (p_bytevec_state, & rda);
 	if (status == 1) break;
-	usleep (1);
-	tcp_activity = do_comms ();
+	do_comms_or_wait ();
     }
 
     while (true) {
-	bool tcp_activity = do_comms ();
-	if (! tcp_activity)
-	    usleep (1000);
+	do_comms_or_wait ();
 
 	int status = Bytevec_dequeue_AXI4L_Rd_Data_d32_u0 (p_bytevec_state, & rdd);
 	if (status == 1) {
@@ -390,7 +713,6 @@ int fpga_pci_peek (uint32_t ocl_addr, uint32_t *p_ocl_data)
 int fpga_pci_poke (uint32_t ocl_addr, uint32_t ocl_data)
 {
     int  verbosity2 = 0;
-    bool tcp_activity;
 
     check_state_initialized ();
 
@@ -408,20 +730,16 @@ int fpga_pci_poke (uint32_t ocl_addr, uint32_t ocl_data)
     while (true) {
 	int status = Bytevec_enqueue_AXI4L_Wr_Addr_a32_u0 (p_bytevec_state, & wra);
 	if (status == 1) break;
-	usleep (1);
-	tcp_activity = do_comms ();
+	do_comms_or_wait ();
     }
     while (true) {
 	int status = Bytevec_enqueue_AXI4L_Wr_Data_d32    (p_bytevec_state, & wrd);
 	if (status == 1) break;
-	usleep (1);
-	tcp_activity = do_comms ();
+	do_comms_or_wait ();
     }
 
     while (true) {
-	bool tcp_activity = do_comms ();
-	if (! tcp_activity)
-	    usleep (1);
+	do_comms_or_wait ();
 
 	int status = Bytevec_dequeue_AXI4L_Wr_Resp_u0 (p_bytevec_state, & wrr);
 	if (status == 1) break;
@@ -6,12 +6,52 @@ void AWS_Sim_Lib_init (void);
 extern
 void AWS_Sim_Lib_shutdown (void);
 
+// ----------------
+// Synchronous DMA bursts.
+// The buffer may start and end at any byte address, but must not cross
+// a 4KB boundary.  Writes of partial beats use wstrb, so no
+// read-modify-write is needed.  Return 0 if ok, 1 if error.
+
 extern
 int fpga_dma_burst_read (int fd, uint8_t *buffer, size_t size, uint64_t address);
 
 extern
 int fpga_dma_burst_write (int fd, uint8_t *buffer, size_t size, uint64_t address);
 
+// ----------------
+// Asynchronous DMA.
+// The *_submit functions issue a burst and return a handle (or -1 if
+// error) without waiting for the response; up to 16 reads and 16
+// writes can be outstanding (each uses a distinct AXI4 ID).
+// A read's buffer must remain valid until the handle completes.
+// fpga_dma_poll returns 1 when complete (*p_err: 0 ok, 1 error), 0 if
+// still pending.  fpga_dma_wait blocks, and returns 0 ok or 1 error.
+// A completed handle is released by the poll or wait that reports it.
+
+extern
+int fpga_dma_burst_read_submit (int fd, uint8_t *buffer, size_t size, uint64_t address);
+
+extern
+int fpga_dma_burst_write_submit (int fd, uint8_t *buffer, size_t size, uint64_t address);
+
+extern
+int fpga_dma_poll (int handle, int *p_err);
+
+extern
+int fpga_dma_wait (int handle);
+
+// ----------------
+// Large transfers of any size and alignment, split into bursts at
+// 4KB boundaries and pipelined.  Return 0 if ok, 1 if error.
+
+extern
+int fpga_dma_read (int fd, uint8_t *buffer, size_t size, uint64_t address);
+
+extern
+int fpga_dma_write (int fd, uint8_t *buffer, size_t size, uint64_t address);
+
+// ----------------
+
 extern
 int fpga_pci_peek (uint32_t ocl_addr, uint32_t *p_ocl_data);
 
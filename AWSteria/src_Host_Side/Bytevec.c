@@ -359,6 +359,35 @@ int Bytevec_struct_to_bytevec (Bytevec_state *p_state)
     return 0;
 }
 
+// ================================================================
+// C to BSV struct->bytevec batch encoder
+// Encodes every ready struct (up to available credits) into
+// p_state->bytevec_C_to_BSV_batch, as a sequence of ordinary packets,
+// so that they can all be sent together.
+// Credits are carried by the first packet only.
+// Returns # of bytes in the batch (0 if nothing to send)
+
+int Bytevec_struct_to_bytevec_batch (Bytevec_state *p_state)
+{
+    int verbosity2 = 0;    // local verbosity for this function
+
+    uint32_t n_bytes = 0;
+    uint32_t n_pkts  = 0;
+    while ((n_bytes + 79) <= C_TO_BSV_BATCH_BYTES) {
+        if (! Bytevec_struct_to_bytevec (p_state)) break;
+
+        uint8_t size = p_state->bytevec_C_to_BSV [0];
+        memcpy (p_state->bytevec_C_to_BSV_batch + n_bytes, p_state->bytevec_C_to_BSV, size);
+        n_bytes += size;
+        n_pkts  += 1;
+    }
+    p_state->bytevec_C_to_BSV_batch_size = n_bytes;
+
+    if ((verbosity2 != 0) && (n_pkts != 0))
+        fprintf (stdout, "Bytevec_struct_to_bytevec_batch: %0d packets, %0d bytes\n", n_pkts, n_bytes);
+    return n_bytes;
+}
+
 // ================================================================
 // BSV to C bytevec->struct decoder
 // p_state->bytevec_BSV_to_C contains a bytevec
@@ -380,8 +409,9 @@ int Bytevec_struct_from_bytevec (Bytevec_state *p_state)
     // BSV to C: AXI4_Wr_Resp_i16_u0
     if (p_state->bytevec_BSV_to_C [7] == 1) {
         // ---- Fill in struct from payload
-        uint64_t head_index = (p_state->head_AXI4_Wr_Resp_i16_u0 & BSV_TO_C_FIFO_INDEX_MASK);
-        AXI4_Wr_Resp_i16_u0_from_bytevec (& p_state->buf_AXI4_Wr_Resp_i16_u0 [head_index],
+        uint64_t tail_index = ((p_state->head_AXI4_Wr_Resp_i16_u0 + p_state->size_AXI4_Wr_Resp_i16_u0)
+                               & BSV_TO_C_FIFO_INDEX_MASK);
+        AXI4_Wr_Resp_i16_u0_from_bytevec (& p_state->buf_AXI4_Wr_Resp_i16_u0 [tail_index],
                                        p_state->bytevec_BSV_to_C + 7 + 1);
         // ---- Enqueue the struct
         p_state->size_AXI4_Wr_Resp_i16_u0 += 1;
@@ -393,8 +423,9 @@ int Bytevec_struct_from_bytevec (Bytevec_state *p_state)
     // BSV to C: AXI4_Rd_Data_i16_d512_u0
     if (p_state->bytevec_BSV_to_C [7] == 2) {
         // ---- Fill in struct from payload
-        uint64_t head_index = (p_state->head_AXI4_Rd_Data_i16_d512_u0 & BSV_TO_C_FIFO_INDEX_MASK);
-        AXI4_Rd_Data_i16_d512_u0_from_bytevec (& p_state->buf_AXI4_Rd_Data_i16_d512_u0 [head_index],
+        uint64_t tail_index = ((p_state->head_AXI4_Rd_Data_i16_d512_u0 + p_state->size_AXI4_Rd_Data_i16_d512_u0)
+                               & BSV_TO_C_FIFO_INDEX_MASK);
+        AXI4_Rd_Data_i16_d512_u0_from_bytevec (& p_state->buf_AXI4_Rd_Data_i16_d512_u0 [tail_index],
                                        p_state->bytevec_BSV_to_C + 7 + 1);
         // ---- Enqueue the struct
         p_state->size_AXI4_Rd_Data_i16_d512_u0 += 1;
@@ -406,8 +437,9 @@ int Bytevec_struct_from_bytevec (Bytevec_state *p_state)
     // BSV to C: AXI4L_Wr_Resp_u0
     if (p_state->bytevec_BSV_to_C [7] == 3) {
         // ---- Fill in struct from payload
-        uint64_t head_index = (p_state->head_AXI4L_Wr_Resp_u0 & BSV_TO_C_FIFO_INDEX_MASK);
-        AXI4L_Wr_Resp_u0_from_bytevec (& p_state->buf_AXI4L_Wr_Resp_u0 [head_index],
+        uint64_t tail_index = ((p_state->head_AXI4L_Wr_Resp_u0 + p_state->size_AXI4L_Wr_Resp_u0)
+                               & BSV_TO_C_FIFO_INDEX_MASK);
+        AXI4L_Wr_Resp_u0_from_bytevec (& p_state->buf_AXI4L_Wr_Resp_u0 [tail_index],
                                        p_state->bytevec_BSV_to_C + 7 + 1);
         // ---- Enqueue the struct
         p_state->size_AXI4L_Wr_Resp_u0 += 1;
@@ -419,8 +451,9 @@ int Bytevec_struct_from_bytevec (Bytevec_state *p_state)
     // BSV to C: AXI4L_Rd_Data_d32_u0
     if (p_state->bytevec_BSV_to_C [7] == 4) {
         // ---- Fill in struct from payload
-        uint64_t head_index = (p_state->head_AXI4L_Rd_Data_d32_u0 & BSV_TO_C_FIFO_INDEX_MASK);
-        AXI4L_Rd_Data_d32_u0_from_bytevec (& p_state->buf_AXI4L_Rd_Data_d32_u0 [head_index],
+        uint64_t tail_index = ((p_state->head_AXI4L_Rd_Data_d32_u0 + p_state->size_AXI4L_Rd_Data_d32_u0)
+                               & BSV_TO_C_FIFO_INDEX_MASK);
+        AXI4L_Rd_Data_d32_u0_from_bytevec (& p_state->buf_AXI4L_Rd_Data_d32_u0 [tail_index],
                                        p_state->bytevec_BSV_to_C + 7 + 1);
         // ---- Enqueue the struct
         p_state->size_AXI4L_Rd_Data_d32_u0 += 1;
@@ -433,6 +466,49 @@ int Bytevec_struct_from_bytevec (Bytevec_state *p_state)
     return 0;
 }
 
+// ================================================================
+// BSV to C bytevec->struct batch decoder
+// p_state->bytevec_BSV_to_C_batch contains bytevec_BSV_to_C_batch_size
+// bytes: a sequence of packets, possibly ending with a partial packet.
+// Decodes every complete packet and moves the partial packet (if any)
+// to the front of the batch buffer.
+// A packet whose size byte is below the header size or above the
+// max packet size means the stream is out of sync: exit with an error.
+// Returns # of packets decoded
+
+int Bytevec_struct_from_bytevec_batch (Bytevec_state *p_state)
+{
+    int verbosity2 = 0;    // local verbosity for this function
+
+    uint32_t n_bytes = p_state->bytevec_BSV_to_C_batch_size;
+    uint32_t offset  = 0;
+    uint32_t n_pkts  = 0;
+    while (offset < n_bytes) {
+        uint8_t size = p_state->bytevec_BSV_to_C_batch [offset];
+        if ((size < 8) || (size > 76)) {
+            fprintf (stdout, "ERROR: Bytevec_struct_from_bytevec_batch: bad packet size %0d (expecting 8..76)\n",
+                     size);
+            exit (1);
+        }
+        if ((n_bytes - offset) < size) break;
+
+        memcpy (p_state->bytevec_BSV_to_C, p_state->bytevec_BSV_to_C_batch + offset, size);
+        Bytevec_struct_from_bytevec (p_state);
+        offset += size;
+        n_pkts += 1;
+    }
+
+    // Keep the partial packet, if any
+    memmove (p_state->bytevec_BSV_to_C_batch,
+             p_state->bytevec_BSV_to_C_batch + offset,
+             n_bytes - offset);
+    p_state->bytevec_BSV_to_C_batch_size = n_bytes - offset;
+
+    if ((verbosity2 != 0) && (n_pkts != 0))
+        fprintf (stdout, "Bytevec_struct_from_bytevec_batch: %0d packets, %0d bytes\n", n_pkts, offset);
+    return n_pkts;
+}
+
 // ================================================================
 // Enqueue a AXI4_Wr_Addr_i16_a64_u0 struct to be sent from C to BSV
 // Return 0 if failed (queue overflow) or 1 if success
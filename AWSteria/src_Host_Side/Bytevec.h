@@ -118,6 +118,14 @@ uint8_t       ruser;              // 0 bits
 #define BSV_TO_C_FIFO_SIZE        0x80
 #define BSV_TO_C_FIFO_INDEX_MASK  0x7F
 
+// Max bytes in a batch of C to BSV packets: every C to BSV queue
+// full, with credits, plus one credits-only packet
+#define C_TO_BSV_BATCH_BYTES      (6 * C_TO_BSV_FIFO_SIZE * 79 + 79)
+
+// Max bytes in a batch of BSV to C packets: every BSV to C queue
+// full, plus one credits-only packet
+#define BSV_TO_C_BATCH_BYTES      (4 * BSV_TO_C_FIFO_SIZE * 76 + 76)
+
 typedef struct {
    // C to BSV queues
    AXI4_Wr_Addr_i16_a64_u0  buf_AXI4_Wr_Addr_i16_a64_u0 [C_TO_BSV_FIFO_SIZE];
@@ -174,6 +182,15 @@ typedef struct {
     // Bytevecs for C to BSV and BSV to C packets
     uint8_t bytevec_C_to_BSV [79];
     uint8_t bytevec_BSV_to_C [76];
+
+    // Batch of C to BSV packets (concatenated bytevecs)
+    uint8_t  bytevec_C_to_BSV_batch [C_TO_BSV_BATCH_BYTES];
+    uint32_t bytevec_C_to_BSV_batch_size;
+
+    // Batch of BSV to C packets (concatenated bytevecs, possibly
+    // ending with a partial packet)
+    uint8_t  bytevec_BSV_to_C_batch [BSV_TO_C_BATCH_BYTES];
+    uint32_t bytevec_BSV_to_C_batch_size;
 } Bytevec_state;
 
 // ================================================================
@@ -190,6 +207,17 @@ Bytevec_state *mk_Bytevec_state (void);
 extern
 int Bytevec_struct_to_bytevec (Bytevec_state *p_state);
 
+// ================================================================
+// C to BSV struct->bytevec batch encoder
+// Encodes every ready struct (up to available credits) into
+// p_state->bytevec_C_to_BSV_batch, as a sequence of ordinary packets,
+// so that they can all be sent together.
+// Credits are carried by the first packet only.
+// Returns # of bytes in the batch (0 if nothing to send)
+
+extern
+int Bytevec_struct_to_bytevec_batch (Bytevec_state *p_state);
+
 // ================================================================
 // BSV to C bytevec->struct decoder
 // p_state->bytevec_BSV_to_C contains a bytevec
@@ -199,6 +227,19 @@ int Bytevec_struct_to_bytevec (Bytevec_state *p_state);
 extern
 int Bytevec_struct_from_bytevec (Bytevec_state *p_state);
 
+// ================================================================
+// BSV to C bytevec->struct batch decoder
+// p_state->bytevec_BSV_to_C_batch contains bytevec_BSV_to_C_batch_size
+// bytes: a sequence of packets, possibly ending with a partial packet.
+// Decodes every complete packet and moves the partial packet (if any)
+// to the front of the batch buffer.
+// A packet whose size byte is below the header size or above the
+// max packet size means the stream is out of sync: exit with an error.
+// Returns # of packets decoded
+
+extern
+int Bytevec_struct_from_bytevec_batch (Bytevec_state *p_state);
+
 // ================================================================
 // Enqueue a AXI4_Wr_Addr_i16_a64_u0 struct to be sent from C to BSV
 // Return 0 if failed (queue overflow) or 1 if success
@@ -0,0 +1,284 @@
+// Copyright (c) 2013-2020 Bluespec, Inc. All Rights Reserved
+
+// ================================================================
+// Load an ELF file directly into AWS DDR4 using DMA
+// (no intermediate Mem-hex file or flat memory buffer).
+
+// The file is mmap'd and parsed with the definitions in <elf.h>, and
+// each PT_LOAD segment (found by Elf_Segments.c) is streamed from the
+// mapping straight to DMA.
+
+// ================================================================
+// Standard C includes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// ----------------
+// Project includes
+
+#include "AWS_Sim_Lib.h"
+#include "Elf_Segments.h"
+#include "Elf_Loader.h"
+
+// ================================================================
+// Zeroes, for .bss
+
+#define ZERO_BUF_SIZE  0x10000
+
+static uint8_t zero_buf [ZERO_BUF_SIZE];
+
+// ================================================================
+// Class-independent views of the section headers and symbols we need.
+
+typedef struct {
+    uint32_t  type;
+    uint32_t  link;
+    uint64_t  offset;
+    uint64_t  size;
+    uint64_t  entsize;
+} Shdr;
+
+static
+void get_shdr (const uint8_t *p_file, int bitwidth, uint64_t off, Shdr *p)
+{
+    if (bitwidth == 32) {
+	Elf32_Shdr sh;
+	memcpy (& sh, p_file + off, sizeof (sh));
+	p->type = sh.sh_type;  p->link = sh.sh_link;  p->offset = sh.sh_offset;
+	p->size = sh.sh_size;  p->entsize = sh.sh_entsize;
+    }
+    else {
+	Elf64_Shdr sh;
+	memcpy (& sh, p_file + off, sizeof (sh));
+	p->type = sh.sh_type;  p->link = sh.sh_link;  p->offset = sh.sh_offset;
+	p->size = sh.sh_size;  p->entsize = sh.sh_entsize;
+    }
+}
+
+static
+void get_sym (const uint8_t *p_file, int bitwidth, uint64_t off, uint32_t *p_name, uint64_t *p_value)
+{
+    if (bitwidth == 32) {
+	Elf32_Sym sym;
+	memcpy (& sym, p_file + off, sizeof (sym));
+	*p_name = sym.st_name;  *p_value = sym.st_value;
+    }
+    else {
+	Elf64_Sym sym;
+	memcpy (& sym, p_file + off, sizeof (sym));
+	*p_name = sym.st_name;  *p_value = sym.st_value;
+    }
+}
+
+// ================================================================
+// Write size zero bytes to DDR4 at address
+
+static
+int dma_write_zeroes (int fd, uint64_t address, uint64_t size)
+{
+    while (size != 0) {
+	uint64_t n = ((size < ZERO_BUF_SIZE) ? size : ZERO_BUF_SIZE);
+	if (fpga_dma_write (fd, zero_buf, n, address) != 0)
+	    return 1;
+	address += n;
+	size    -= n;
+    }
+    return 0;
+}
+
+// ================================================================
+// Search the symbol table(s) for the symbols of interest
+
+static
+int find_symbols (const uint8_t *p_file, uint64_t file_size, int bitwidth,
+		  uint64_t shoff, uint64_t shentsize, uint64_t shnum,
+		  Elf_Features *p_features)
+{
+    for (uint64_t j = 0; j < shnum; j++) {
+	Shdr shdr;
+	get_shdr (p_file, bitwidth, shoff + j * shentsize, & shdr);
+	if ((shdr.type != SHT_SYMTAB) || (shdr.entsize == 0))
+	    continue;
+
+	Shdr strtab;
+	if (shdr.link >= shnum) {
+	    fprintf (stdout, "ERROR: elf_load_using_DMA: bad string table index for symbol table\n");
+	    return 1;
+	}
+	get_shdr (p_file, bitwidth, shoff + shdr.link * shentsize, & strtab);
+	if (((shdr.offset + shdr.size) > file_size)
+	    || ((strtab.offset + strtab.size) > file_size)) {
+	    fprintf (stdout, "ERROR: elf_load_using_DMA: symbol table extends beyond end of file\n");
+	    return 1;
+	}
+	const char *strs = (const char *) (p_file + strtab.offset);
+
+	uint64_t n_symbols = shdr.size / shdr.entsize;
+	for (uint64_t k = 0; k < n_symbols; k++) {
+	    uint32_t name_off;
+	    uint64_t value;
+	    get_sym (p_file, bitwidth, shdr.offset + k * shdr.entsize, & name_off, & value);
+	    if (name_off >= strtab.size)
+		continue;
+	    const char *name = strs + name_off;
+	    if (strnlen (name, strtab.size - name_off) == (strtab.size - name_off))
+		continue;    // not NUL-terminated within the table
+
+	    if (strcmp (name, "_start") == 0)
+		p_features->pc_start = value;
+	    else if (strcmp (name, "exit") == 0)
+		p_features->pc_exit = value;
+	    else if (strcmp (name, "tohost") == 0)
+		p_features->tohost_addr = value;
+	}
+    }
+
+    fprintf (stdout, "Symbols of interest\n");
+    fprintf (stdout, "    _start");
+    if (p_features->pc_start == ELF_SYMBOL_NOT_FOUND)
+	fprintf (stdout, "    Not found\n");
+    else
+	fprintf (stdout, "    0x%0" PRIx64 "\n", p_features->pc_start);
+
+    fprintf (stdout, "    exit  ");
+    if (p_features->pc_exit == ELF_SYMBOL_NOT_FOUND)
+	fprintf (stdout, "    Not found\n");
+    else
+	fprintf (stdout, "    0x%0" PRIx64 "\n", p_features->pc_exit);
+
+    fprintf (stdout, "    tohost");
+    if (p_features->tohost_addr == ELF_SYMBOL_NOT_FOUND)
+	fprintf (stdout, "    Not found\n");
+    else
+	fprintf (stdout, "    0x%0" PRIx64 "\n", p_features->tohost_addr);
+
+    return 0;
+}
+
+// ================================================================
+// Download one PT_LOAD segment (called by elf_for_each_load_segment)
+
+typedef struct {
+    int           fd;
+    Elf_Features *p_features;
+} Load_Segment_Arg;
+
+static
+int load_segment (uint64_t seg_num, uint64_t paddr, const uint8_t *p_data,
+		  uint64_t filesz, uint64_t memsz, void *arg)
+{
+    Load_Segment_Arg *p_arg      = (Load_Segment_Arg *) arg;
+    Elf_Features     *p_features = p_arg->p_features;
+
+    fprintf (stdout, "Segment %2" PRId64 ": addr %16" PRIx64 " to addr %16" PRIx64
+	     "; size 0x%8" PRIx64 " bytes (0x%8" PRIx64 " from file)\n",
+	     seg_num, paddr, paddr + memsz, memsz, filesz);
+
+    if (filesz != 0) {
+	if (fpga_dma_write (p_arg->fd, (uint8_t *) p_data, filesz, paddr) != 0) {
+	    fprintf (stdout, "ERROR: elf_load_using_DMA: DMA write failed\n");
+	    return 1;
+	}
+    }
+    if (memsz > filesz) {
+	if (dma_write_zeroes (p_arg->fd, paddr + filesz, memsz - filesz) != 0) {
+	    fprintf (stdout, "ERROR: elf_load_using_DMA: DMA write (zeroes) failed\n");
+	    return 1;
+	}
+    }
+
+    if (paddr < p_features->min_addr)
+	p_features->min_addr = paddr;
+    if (p_features->max_addr < (paddr + memsz - 1))
+	p_features->max_addr = paddr + memsz - 1;
+    return 0;
+}
+
+// ================================================================
+
+int elf_load_using_DMA (int fd, const char *elf_filename, Elf_Features *p_features)
+{
+    int rc = 1;
+
+    p_features->min_addr    = 0xFFFFFFFFFFFFFFFFllu;
+    p_features->max_addr    = 0x0000000000000000llu;
+    p_features->pc_start    = ELF_SYMBOL_NOT_FOUND;
+    p_features->pc_exit     = ELF_SYMBOL_NOT_FOUND;
+    p_features->tohost_addr = ELF_SYMBOL_NOT_FOUND;
+
+    // Open and map the file
+    int elf_fd = open (elf_filename, O_RDONLY, 0);
+    if (elf_fd < 0) {
+	fprintf (stdout, "ERROR: elf_load_using_DMA: could not open elf input file: %s\n",
+		 elf_filename);
+	return 1;
+    }
+    struct stat st;
+    if (fstat (elf_fd, & st) < 0) {
+	fprintf (stdout, "ERROR: elf_load_using_DMA: could not stat: %s\n", elf_filename);
+	close (elf_fd);
+	return 1;
+    }
+    uint64_t file_size = st.st_size;
+    if (file_size < EI_NIDENT) {
+	fprintf (stdout, "ERROR: elf_load_using_DMA: specified file '%s' is not an ELF file!\n",
+		 elf_filename);
+	close (elf_fd);
+	return 1;
+    }
+    const uint8_t *p_file = (const uint8_t *) mmap (NULL, file_size, PROT_READ, MAP_PRIVATE, elf_fd, 0);
+    close (elf_fd);
+    if (p_file == MAP_FAILED) {
+	fprintf (stdout, "ERROR: elf_load_using_DMA: could not mmap: %s\n", elf_filename);
+	return 1;
+    }
+
+    Elf_Hdr_Info  hdr;
+    if (elf_read_hdr ("elf_load_using_DMA", elf_filename, p_file, file_size, & hdr) != 0)
+	goto done;
+    p_features->bitwidth = hdr.bitwidth;
+    fprintf (stdout, "elf_load_using_DMA: %s is a %0d-bit ELF file\n", elf_filename, hdr.bitwidth);
+
+    // Verify we are dealing with a RISC-V ELF
+    if (hdr.machine != EM_RISCV) {
+	fprintf (stdout, "ERROR: elf_load_using_DMA: %s is not a RISC-V ELF file\n",
+		 elf_filename);
+	goto done;
+    }
+
+    // ----------------
+    // Load each PT_LOAD segment
+
+    Load_Segment_Arg  seg_arg = {.fd = fd, .p_features = p_features};
+    if (elf_for_each_load_segment ("elf_load_using_DMA", elf_filename, p_file, file_size,
+				   & hdr, load_segment, & seg_arg) != 0)
+	goto done;
+
+    // ----------------
+    // Symbols
+
+    if (find_symbols (p_file, file_size, hdr.bitwidth,
+		      hdr.shoff, hdr.shentsize, hdr.shnum, p_features) != 0)
+	goto done;
+
+    fprintf (stdout, "Min addr:            %16" PRIx64 " (hex)\n", p_features->min_addr);
+    fprintf (stdout, "Max addr:            %16" PRIx64 " (hex)\n", p_features->max_addr);
+    rc = 0;
+
+ done:
+    munmap ((void *) p_file, file_size);
+    return rc;
+}
+
+// ================================================================
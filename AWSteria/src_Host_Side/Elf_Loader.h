@@ -0,0 +1,38 @@
+// Copyright (c) 2013-2020 Bluespec, Inc. All Rights Reserved
+
+// ================================================================
+// Load an ELF file directly into AWS DDR4 using DMA
+// (no intermediate Mem-hex file or flat memory buffer).
+
+// ================================================================
+
+#pragma once
+
+// ================================================================
+// Features of the ELF binary
+
+typedef struct {
+    int       bitwidth;       // 32 or 64
+    uint64_t  min_addr;
+    uint64_t  max_addr;       // Last byte addr loaded (inclusive)
+
+    uint64_t  pc_start;       // Addr of label  '_start'
+    uint64_t  pc_exit;        // Addr of label  'exit'
+    uint64_t  tohost_addr;    // Addr of label  'tohost'
+} Elf_Features;
+
+// Value of a symbol addr in Elf_Features if the symbol was not found
+#define ELF_SYMBOL_NOT_FOUND  0xFFFFFFFFFFFFFFFFllu
+
+// ================================================================
+// Load the PT_LOAD segments of a RISC-V ELF file into DDR4 at their
+// physical addresses using fpga_dma_write() (which splits into
+// 4KB-bounded bursts); the part of each segment beyond its file
+// image (.bss) is written with zeroes.
+// Also looks up the '_start', 'exit' and 'tohost' symbols.
+// Returns 0 if ok, 1 if error.
+
+extern
+int elf_load_using_DMA (int fd, const char *elf_filename, Elf_Features *p_features);
+
+// ================================================================
@@ -0,0 +1,142 @@
+// Copyright (c) 2013-2020 Bluespec, Inc. All Rights Reserved
+
+// ================================================================
+// Walk the PT_LOAD segments of a little-endian 32b or 64b ELF file,
+// using the definitions in <elf.h>.
+
+// ================================================================
+// Standard C includes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <elf.h>
+
+// ----------------
+// Project includes
+
+#include "Elf_Segments.h"
+
+// ================================================================
+// Class-independent view of a program header
+
+typedef struct {
+    uint32_t  type;
+    uint64_t  offset;
+    uint64_t  paddr;
+    uint64_t  filesz;
+    uint64_t  memsz;
+} Phdr;
+
+static
+void get_phdr (const uint8_t *p_file, int bitwidth, uint64_t off, Phdr *p)
+{
+    if (bitwidth == 32) {
+	Elf32_Phdr ph;
+	memcpy (& ph, p_file + off, sizeof (ph));
+	p->type = ph.p_type;  p->offset = ph.p_offset;  p->paddr = ph.p_paddr;
+	p->filesz = ph.p_filesz;  p->memsz = ph.p_memsz;
+    }
+    else {
+	Elf64_Phdr ph;
+	memcpy (& ph, p_file + off, sizeof (ph));
+	p->type = ph.p_type;  p->offset = ph.p_offset;  p->paddr = ph.p_paddr;
+	p->filesz = ph.p_filesz;  p->memsz = ph.p_memsz;
+    }
+}
+
+// ================================================================
+
+int elf_read_hdr (const char     *caller,
+		  const char     *filename,
+		  const uint8_t  *p_file,
+		  uint64_t        file_size,
+		  Elf_Hdr_Info   *p_hdr)
+{
+    // Verify that the file is an ELF file
+    if ((file_size < EI_NIDENT) || (memcmp (p_file, ELFMAG, SELFMAG) != 0)) {
+	fprintf (stdout, "ERROR: %s: specified file '%s' is not an ELF file!\n",
+		 caller, filename);
+	return 1;
+    }
+
+    // Is this a 32b or 64 ELF?
+    if ((p_file [EI_CLASS] == ELFCLASS32) && (file_size >= sizeof (Elf32_Ehdr)))
+	p_hdr->bitwidth = 32;
+    else if ((p_file [EI_CLASS] == ELFCLASS64) && (file_size >= sizeof (Elf64_Ehdr)))
+	p_hdr->bitwidth = 64;
+    else {
+	fprintf (stdout, "ERROR: %s: ELF file '%s' is not 32b or 64b\n", caller, filename);
+	return 1;
+    }
+
+    // Verify we are dealing with a little endian ELF
+    if (p_file [EI_DATA] != ELFDATA2LSB) {
+	fprintf (stdout, "ERROR: %s: %s is big-endian, not supported\n", caller, filename);
+	return 1;
+    }
+
+    // Get the fields of the ELF header we need
+    if (p_hdr->bitwidth == 32) {
+	Elf32_Ehdr ehdr;
+	memcpy (& ehdr, p_file, sizeof (ehdr));
+	p_hdr->machine = ehdr.e_machine;
+	p_hdr->phoff   = ehdr.e_phoff;  p_hdr->phentsize = ehdr.e_phentsize;  p_hdr->phnum = ehdr.e_phnum;
+	p_hdr->shoff   = ehdr.e_shoff;  p_hdr->shentsize = ehdr.e_shentsize;  p_hdr->shnum = ehdr.e_shnum;
+    }
+    else {
+	Elf64_Ehdr ehdr;
+	memcpy (& ehdr, p_file, sizeof (ehdr));
+	p_hdr->machine = ehdr.e_machine;
+	p_hdr->phoff   = ehdr.e_phoff;  p_hdr->phentsize = ehdr.e_phentsize;  p_hdr->phnum = ehdr.e_phnum;
+	p_hdr->shoff   = ehdr.e_shoff;  p_hdr->shentsize = ehdr.e_shentsize;  p_hdr->shnum = ehdr.e_shnum;
+    }
+
+    uint64_t min_phentsize = ((p_hdr->bitwidth == 32) ? sizeof (Elf32_Phdr) : sizeof (Elf64_Phdr));
+    uint64_t min_shentsize = ((p_hdr->bitwidth == 32) ? sizeof (Elf32_Shdr) : sizeof (Elf64_Shdr));
+    if ((p_hdr->phnum != 0)
+	&& ((p_hdr->phentsize < min_phentsize)
+	    || ((p_hdr->phoff + p_hdr->phnum * p_hdr->phentsize) > file_size))) {
+	fprintf (stdout, "ERROR: %s: bad program header table in %s\n", caller, filename);
+	return 1;
+    }
+    if ((p_hdr->shnum != 0)
+	&& ((p_hdr->shentsize < min_shentsize)
+	    || ((p_hdr->shoff + p_hdr->shnum * p_hdr->shentsize) > file_size))) {
+	fprintf (stdout, "ERROR: %s: bad section header table in %s\n", caller, filename);
+	return 1;
+    }
+    return 0;
+}
+
+// ================================================================
+
+int elf_for_each_load_segment (const char          *caller,
+			       const char          *filename,
+			       const uint8_t       *p_file,
+			       uint64_t             file_size,
+			       const Elf_Hdr_Info  *p_hdr,
+			       Elf_Segment_Fn       f,
+			       void                *arg)
+{
+    for (uint64_t j = 0; j < p_hdr->phnum; j++) {
+	Phdr phdr;
+	get_phdr (p_file, p_hdr->bitwidth, p_hdr->phoff + j * p_hdr->phentsize, & phdr);
+	if ((phdr.type != PT_LOAD) || (phdr.memsz == 0))
+	    continue;
+
+	if ((phdr.filesz > phdr.memsz) || ((phdr.offset + phdr.filesz) > file_size)) {
+	    fprintf (stdout, "ERROR: %s: bad PT_LOAD segment %0" PRId64 " in %s\n",
+		     caller, j, filename);
+	    return 1;
+	}
+
+	if (f (j, phdr.paddr, p_file + phdr.offset, phdr.filesz, phdr.memsz, arg) != 0)
+	    return 1;
+    }
+    return 0;
+}
+
+// ================================================================
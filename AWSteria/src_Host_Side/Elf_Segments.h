@@ -0,0 +1,60 @@
+// Copyright (c) 2013-2020 Bluespec, Inc. All Rights Reserved
+
+// ================================================================
+// Walk the PT_LOAD segments of a little-endian 32b or 64b ELF file
+// that has been mmap'd (or read) into memory.
+
+// Shared by the host-side DMA loader (Elf_Loader.c) and the
+// simulation's memory-model preload (C_Imported_Functions.c).
+
+// ================================================================
+
+#pragma once
+
+// ================================================================
+// The fields of the ELF header that the loaders need
+
+typedef struct {
+    int       bitwidth;       // 32 or 64
+    uint16_t  machine;
+    uint64_t  phoff, phentsize, phnum;
+    uint64_t  shoff, shentsize, shnum;
+} Elf_Hdr_Info;
+
+// ================================================================
+// Check that p_file [0 .. file_size-1] is a little-endian 32b or 64b
+// ELF file with well-formed program and section header tables, and
+// fill in *p_hdr.  Errors are reported as 'ERROR: <caller>: ...'.
+// Returns 0 if ok, 1 if error.
+
+extern
+int elf_read_hdr (const char     *caller,
+		  const char     *filename,
+		  const uint8_t  *p_file,
+		  uint64_t        file_size,
+		  Elf_Hdr_Info   *p_hdr);
+
+// ================================================================
+// Call f on each non-empty PT_LOAD segment, in program-header order,
+// with its physical address, its file image (filesz bytes) and its
+// size in memory (memsz >= filesz; the rest is .bss).
+// Stops if f returns non-zero.
+// Returns 0 if ok, 1 if a segment is malformed or f returned non-zero.
+
+typedef int (*Elf_Segment_Fn) (uint64_t        seg_num,
+			       uint64_t        paddr,
+			       const uint8_t  *p_data,
+			       uint64_t        filesz,
+			       uint64_t        memsz,
+			       void           *arg);
+
+extern
+int elf_for_each_load_segment (const char          *caller,
+			       const char          *filename,
+			       const uint8_t       *p_file,
+			       uint64_t             file_size,
+			       const Elf_Hdr_Info  *p_hdr,
+			       Elf_Segment_Fn       f,
+			       void                *arg);
+
+// ================================================================
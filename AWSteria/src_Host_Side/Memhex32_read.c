@@ -5,6 +5,12 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "Memhex32_read.h"
 
@@ -53,11 +59,11 @@ int memhex32_read (char      *filename,
 		    fprintf (stdout, "WARNING on line %0d\n", linenum);
 		    fprintf (stdout, "    Address 0x%0lx is < latest address 0x%0lx\n", x, addr);
 		}
-		else if ((addr & 0x3) != 0) {
+		else if ((x & 0x3) != 0) {
 		    fprintf (stdout, "WARNING on line %0d\n", linenum);
 		    fprintf (stdout, "    Address 0x%0lx is not 32-bit aligned\n", x);
 		}
-		addr = (x & 0xFFFFFFFC);
+		addr = (x & (~ ((uint64_t) 0x3)));
 		if (addr < addr_base) addr_base = addr;
 		if (addr_lim < addr)  addr_lim = addr;
 	    }
@@ -125,31 +131,454 @@ ok_return:
 }
 
 // ================================================================
+// Sparse, parallel mem-hex32 reader
 
-#ifdef STANDALONE_TEST
+// The file is mmap'd and split into chunks at line boundaries; each
+// chunk is parsed on its own thread into a list of 'runs' (a run is
+// the data words following an '@addr' line, or, for the first run of
+// a chunk, the words preceding the first '@addr' line, whose address
+// depends on the preceding chunks).  The runs are then stitched
+// together in file order to resolve addresses, and contiguous runs
+// are merged into extents.
+
+// Files smaller than this are parsed on a single thread
+#define MEMHEX32_MIN_CHUNK_BYTES  (4 * 1024 * 1024)
+
+// Max # of parser threads when n_threads == 0
+#define MEMHEX32_MAX_THREADS      8
+
+typedef struct {
+    bool       has_addr;    // run starts with an '@addr' line
+    uint64_t   addr;
+    uint64_t   size;        // # of bytes in data
+    uint64_t   capacity;    // # of bytes allocated for data
+    uint8_t   *data;
+} Run;
+
+typedef struct {
+    // Inputs
+    const char  *p_start;
+    const char  *p_end;
 
-#define BUF_SIZE 0x200000000llu
+    // Outputs
+    uint64_t     n_runs;
+    uint64_t     max_runs;
+    Run         *runs;
+    const char  *p_err;     // where the first syntax error was found, if any
+    const char  *err_msg;
+} Chunk;
 
-uint8_t buf [BUF_SIZE];
+// ----------------------------------------------------------------
+// Hex-digit decode table: digit value, or 0xFF for non-hex chars
+
+static uint8_t hex_table [256];
+static bool    hex_table_ok = false;
+
+static void hex_table_init (void)
+{
+    memset (hex_table, 0xFF, sizeof (hex_table));
+    for (int j = 0; j < 10; j++) hex_table ['0' + j] = j;
+    for (int j = 0; j < 6; j++) {
+	hex_table ['a' + j] = 10 + j;
+	hex_table ['A' + j] = 10 + j;
+    }
+    hex_table_ok = true;
+}
+
+// ----------------------------------------------------------------
+// Decode exactly 8 hex digits at p into *p_x, eight at a time in a
+// 64-bit word (SWAR).  Returns false if any of them is not a hex digit.
+
+#define REP8(b)  (0x0101010101010101llu * (b))
+
+static inline bool hex8_decode (const char *p, uint32_t *p_x)
+{
+    uint64_t v;
+    memcpy (& v, p, 8);    // little-endian: p [0] is in the LSB
+
+    // Range check each byte: '0'..'9', 'A'..'F', 'a'..'f'
+    // (all bytes < 0x80, so the additions do not carry across bytes)
+    if ((v & REP8 (0x80)) != 0) return false;
+#define IN_RANGE(lo,hi) (((v + REP8 (0x80 - (lo))) & (~ (v + REP8 (0x80 - (hi) - 1)))) & REP8 (0x80))
+    uint64_t ok = IN_RANGE ('0', '9') | IN_RANGE ('A', 'F') | IN_RANGE ('a', 'f');
+#undef IN_RANGE
+    if (ok != REP8 (0x80)) return false;
+
+    // Nibble values: low 4 bits, plus 9 for letters (bit 6 set)
+    v = (v & REP8 (0x0F)) + (((v >> 6) & REP8 (0x01)) * 9);
+
+    // Pack nibbles, most-significant first, into 32 bits
+    v = ((v & 0x00FF00FF00FF00FFllu) << 4)  | ((v >> 8)  & 0x00FF00FF00FF00FFllu);
+    v = ((v & 0x0000FFFF0000FFFFllu) << 8)  | ((v >> 16) & 0x0000FFFF0000FFFFllu);
+    v = ((v & 0x00000000FFFFFFFFllu) << 16) | (v >> 32);
+    *p_x = (uint32_t) v;
+    return true;
+}
+
+// ----------------------------------------------------------------
+// Decode a hex number at *pp (at least one digit), advancing *pp past it
+
+static inline bool hex_decode (const char **pp, const char *p_end, uint64_t *p_x)
+{
+    const char *p = *pp;
+    uint64_t    x = 0;
+    int         n = 0;
+    while (p < p_end) {
+	uint8_t d = hex_table [(uint8_t) *p];
+	if (d == 0xFF) break;
+	x = (x << 4) | d;
+	p++;
+	n++;
+    }
+    *pp  = p;
+    *p_x = x;
+    return (n != 0);
+}
+
+// ----------------------------------------------------------------
+
+static Run *chunk_new_run (Chunk *p_chunk, bool has_addr, uint64_t addr)
+{
+    if (p_chunk->n_runs == p_chunk->max_runs) {
+	p_chunk->max_runs = ((p_chunk->max_runs == 0) ? 16 : (2 * p_chunk->max_runs));
+	p_chunk->runs = (Run *) realloc (p_chunk->runs, p_chunk->max_runs * sizeof (Run));
+	if (p_chunk->runs == NULL) {
+	    fprintf (stdout, "memhex32_read_image: ERROR allocating runs\n");
+	    exit (1);
+	}
+    }
+    Run *p_run = & (p_chunk->runs [p_chunk->n_runs]);
+    p_chunk->n_runs++;
+    p_run->has_addr = has_addr;
+    p_run->addr     = addr;
+    p_run->size     = 0;
+    p_run->capacity = 0;
+    p_run->data     = NULL;
+    return p_run;
+}
+
+static inline void run_append_word (Run *p_run, uint32_t x)
+{
+    if (p_run->size == p_run->capacity) {
+	p_run->capacity = ((p_run->capacity == 0) ? 4096 : (2 * p_run->capacity));
+	p_run->data = (uint8_t *) realloc (p_run->data, p_run->capacity);
+	if (p_run->data == NULL) {
+	    fprintf (stdout, "memhex32_read_image: ERROR allocating %0ld bytes\n", p_run->capacity);
+	    exit (1);
+	}
+    }
+    memcpy (p_run->data + p_run->size, & x, 4);
+    p_run->size += 4;
+}
+
+// ----------------------------------------------------------------
+// Parse one chunk (a sequence of whole lines).
+// As in memhex32_read(), a line is an address if it starts with '@',
+// data if it starts with a hex digit, and is skipped otherwise.
+
+static void *chunk_parse (void *arg)
+{
+    Chunk      *p_chunk = (Chunk *) arg;
+    const char *p       = p_chunk->p_start;
+    const char *p_end   = p_chunk->p_end;
+    Run        *p_run   = chunk_new_run (p_chunk, false, 0);
+
+    while (p < p_end) {
+	const char *p_line = p;
+	uint64_t    x;
+
+	if (*p == '@') {
+	    p++;
+	    if (! hex_decode (& p, p_end, & x)) {
+		p_chunk->p_err   = p_line;
+		p_chunk->err_msg = "Error parsing address after '@'";
+		return NULL;
+	    }
+	    p_run = chunk_new_run (p_chunk, true, x);
+	}
+	else if (hex_table [(uint8_t) *p] != 0xFF) {
+	    uint32_t  x32;
+	    // Fast path: exactly 8 hex digits followed by end-of-line
+	    if (((p_end - p) >= 9)
+		&& ((p [8] == '\n') || (p [8] == '\r'))
+		&& hex8_decode (p, & x32)) {
+		p += 8;
+	    }
+	    else {
+		hex_decode (& p, p_end, & x);
+		x32 = (uint32_t) x;
+	    }
+	    run_append_word (p_run, x32);
+	}
+
+	// Skip the rest of the line
+	const char *p_nl = memchr (p, '\n', p_end - p);
+	p = ((p_nl == NULL) ? p_end : p_nl + 1);
+    }
+    return NULL;
+}
+
+// ----------------------------------------------------------------
+
+static uint64_t line_number (const char *p_file, const char *p)
+{
+    uint64_t linenum = 1;
+    for (const char *q = p_file; q < p; q++)
+	if (*q == '\n') linenum++;
+    return linenum;
+}
+
+// Trim the data of the last extent to its size
+
+static void image_trim_last_extent (Memhex32_Image *p_image)
+{
+    if (p_image->n_extents != 0) {
+	Memhex32_Extent *p_last = & (p_image->extents [p_image->n_extents - 1]);
+	p_last->data = (uint8_t *) realloc (p_last->data, p_last->size);
+    }
+}
+
+// Add a run to the image, merging it into the last extent if contiguous.
+// Only the last extent can grow: its allocated size is *p_last_capacity,
+// grown geometrically (as in run_append_word), so that a long sequence
+// of contiguous runs is not copied over and over.
+
+static void image_add_extent (Memhex32_Image  *p_image,
+			      uint64_t        *p_max_extents,
+			      uint64_t        *p_last_capacity,
+			      Run             *p_run)
+{
+    if (p_run->size == 0) {
+	free (p_run->data);
+	return;
+    }
+
+    if (p_run->addr < p_image->addr_base) p_image->addr_base = p_run->addr;
+    if (p_image->addr_lim < p_run->addr + p_run->size) p_image->addr_lim = p_run->addr + p_run->size;
+
+    // Merge into the previous extent if contiguous
+    if (p_image->n_extents != 0) {
+	Memhex32_Extent *p_prev = & (p_image->extents [p_image->n_extents - 1]);
+	if (p_prev->addr + p_prev->size == p_run->addr) {
+	    uint64_t size = p_prev->size + p_run->size;
+	    if (size > *p_last_capacity) {
+		*p_last_capacity = ((size > (2 * *p_last_capacity)) ? size : (2 * *p_last_capacity));
+		p_prev->data = (uint8_t *) realloc (p_prev->data, *p_last_capacity);
+		if (p_prev->data == NULL) {
+		    fprintf (stdout, "memhex32_read_image: ERROR allocating %0ld bytes\n",
+			     *p_last_capacity);
+		    exit (1);
+		}
+	    }
+	    memcpy (p_prev->data + p_prev->size, p_run->data, p_run->size);
+	    p_prev->size += p_run->size;
+	    free (p_run->data);
+	    return;
+	}
+    }
+
+    image_trim_last_extent (p_image);
+
+    if (p_image->n_extents == *p_max_extents) {
+	*p_max_extents = ((*p_max_extents == 0) ? 16 : (2 * *p_max_extents));
+	p_image->extents = (Memhex32_Extent *) realloc (p_image->extents,
+							*p_max_extents * sizeof (Memhex32_Extent));
+	if (p_image->extents == NULL) {
+	    fprintf (stdout, "memhex32_read_image: ERROR allocating extents\n");
+	    exit (1);
+	}
+    }
+    Memhex32_Extent *p_ext = & (p_image->extents [p_image->n_extents]);
+    p_image->n_extents++;
+    p_ext->addr = p_run->addr;
+    p_ext->size = p_run->size;
+    p_ext->data = p_run->data;
+    *p_last_capacity = p_run->capacity;
+}
+
+// ----------------------------------------------------------------
+
+int memhex32_read_image (const char      *filename,
+			 int              n_threads,
+			 Memhex32_Image  *p_image)
+{
+    p_image->n_extents = 0;
+    p_image->extents   = NULL;
+    p_image->addr_base = 0;
+    p_image->addr_lim  = 0;
+
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0) {
+	fprintf (stdout, "memhex32_read_image ERROR: unable to open file: %s\n", filename);
+	char *p = getenv ("PWD");
+	if (p != NULL)
+	    fprintf (stdout, "    PWD =  %s\n", p);
+	return 1;
+    }
+
+    struct stat st;
+    if (fstat (fd, & st) < 0) {
+	fprintf (stdout, "memhex32_read_image ERROR: unable to stat file: %s\n", filename);
+	close (fd);
+	return 1;
+    }
+    uint64_t file_size = st.st_size;
+    if (file_size == 0) {
+	close (fd);
+	return 0;
+    }
+
+    const char *p_file = (const char *) mmap (NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (p_file == MAP_FAILED) {
+	fprintf (stdout, "memhex32_read_image ERROR: unable to mmap file: %s\n", filename);
+	return 1;
+    }
+    madvise ((void *) p_file, file_size, MADV_SEQUENTIAL);
+
+    if (! hex_table_ok) hex_table_init ();
+
+    // ----------------
+    // Split into chunks at line boundaries
+
+    if (n_threads <= 0) {
+	n_threads = sysconf (_SC_NPROCESSORS_ONLN);
+	if (n_threads > MEMHEX32_MAX_THREADS) n_threads = MEMHEX32_MAX_THREADS;
+    }
+    if (n_threads > (file_size / MEMHEX32_MIN_CHUNK_BYTES))
+	n_threads = file_size / MEMHEX32_MIN_CHUNK_BYTES;
+    if (n_threads < 1) n_threads = 1;
+
+    Chunk *chunks = (Chunk *) calloc (n_threads, sizeof (Chunk));
+    if (chunks == NULL) {
+	fprintf (stdout, "memhex32_read_image: ERROR allocating chunks\n");
+	exit (1);
+    }
+
+    const char *p_end = p_file + file_size;
+    const char *p     = p_file;
+    int n_chunks = 0;
+    for (int j = 0; (j < n_threads) && (p < p_end); j++) {
+	const char *p_chunk_end = ((j == n_threads - 1)
+				   ? p_end
+				   : p_file + ((file_size * (j + 1)) / n_threads));
+	if (p_chunk_end < p) p_chunk_end = p;
+	const char *p_nl = memchr (p_chunk_end, '\n', p_end - p_chunk_end);
+	p_chunk_end = ((p_nl == NULL) ? p_end : p_nl + 1);
+
+	chunks [n_chunks].p_start = p;
+	chunks [n_chunks].p_end   = p_chunk_end;
+	n_chunks++;
+	p = p_chunk_end;
+    }
+
+    // ----------------
+    // Parse the chunks (chunk 0 on this thread)
+
+    pthread_t *threads = (pthread_t *) calloc (n_chunks, sizeof (pthread_t));
+    for (int j = 1; j < n_chunks; j++) {
+	if (pthread_create (& threads [j], NULL, chunk_parse, & chunks [j]) != 0) {
+	    fprintf (stdout, "memhex32_read_image: ERROR creating parser thread\n");
+	    exit (1);
+	}
+    }
+    chunk_parse (& chunks [0]);
+    for (int j = 1; j < n_chunks; j++)
+	pthread_join (threads [j], NULL);
+    free (threads);
+
+    // ----------------
+    // Stitch the runs together in file order
+
+    int       rc = 0;
+    uint64_t  addr = 0;
+    uint64_t  max_extents = 0;
+    uint64_t  last_capacity = 0;
+    p_image->addr_base = (~ ((uint64_t) 0));
+
+    for (int j = 0; j < n_chunks; j++) {
+	Chunk *p_chunk = & (chunks [j]);
+	for (uint64_t k = 0; k < p_chunk->n_runs; k++) {
+	    Run *p_run = & (p_chunk->runs [k]);
+	    if (rc != 0) {
+		free (p_run->data);
+		continue;
+	    }
+	    if (p_run->has_addr) {
+		if (p_run->addr < addr) {
+		    fprintf (stdout, "WARNING: Address 0x%0lx is < latest address 0x%0lx\n",
+			     p_run->addr, addr);
+		}
+		else if ((p_run->addr & 0x3) != 0) {
+		    fprintf (stdout, "WARNING: Address 0x%0lx is not 32-bit aligned\n", p_run->addr);
+		}
+		p_run->addr = (p_run->addr & (~ ((uint64_t) 0x3)));
+	    }
+	    else
+		p_run->addr = addr;
+	    addr = p_run->addr + p_run->size;
+
+	    image_add_extent (p_image, & max_extents, & last_capacity, p_run);
+	}
+	free (p_chunk->runs);
+
+	if ((rc == 0) && (p_chunk->p_err != NULL)) {
+	    fprintf (stdout, "ERROR on line %0ld: syntax\n", line_number (p_file, p_chunk->p_err));
+	    fprintf (stdout, "    %s\n", p_chunk->err_msg);
+	    rc = 1;
+	}
+    }
+    free (chunks);
+    munmap ((void *) p_file, file_size);
+    image_trim_last_extent (p_image);
+
+    if (rc != 0) {
+	memhex32_image_free (p_image);
+	return 1;
+    }
+    if (p_image->n_extents == 0)
+	p_image->addr_base = 0;
+    return 0;
+}
+
+// ----------------------------------------------------------------
+
+void memhex32_image_free (Memhex32_Image  *p_image)
+{
+    for (uint64_t j = 0; j < p_image->n_extents; j++)
+	free (p_image->extents [j].data);
+    free (p_image->extents);
+    p_image->n_extents = 0;
+    p_image->extents   = NULL;
+}
+
+// ================================================================
+
+#ifdef STANDALONE_TEST
 
 int main (int argc, char *argv [])
 {
     if (argc < 2) {
-	fprintf (stdout, "Usage:    %s  <mem-hex filename>\n", argv [0]);
+	fprintf (stdout, "Usage:    %s  <mem-hex filename>  [<n_threads>]\n", argv [0]);
 	return 0;
     }
+    int n_threads = ((argc > 2) ? atoi (argv [2]) : 0);
 
-    uint64_t addr_base, addr_lim;
-
-    int retcode = memhex32_read (argv [1], buf, BUF_SIZE, & addr_base, & addr_lim);
+    Memhex32_Image  image;
+    int retcode = memhex32_read_image (argv [1], n_threads, & image);
     if (retcode != 0)
 	return 1;
 
-    fprintf (stdout, "@%0lx\n", addr_base);
-    for (uint64_t addr = addr_base; addr < addr_lim; addr += 4) {
-	uint32_t *p = (uint32_t *) (& buf [addr]);
-	fprintf (stdout, "%08x\n", *p);
+    for (uint64_t j = 0; j < image.n_extents; j++) {
+	Memhex32_Extent *p_ext = & (image.extents [j]);
+	fprintf (stdout, "@%0lx\n", p_ext->addr);
+	for (uint64_t k = 0; k < p_ext->size; k += 4) {
+	    uint32_t x;
+	    memcpy (& x, p_ext->data + k, 4);
+	    fprintf (stdout, "%08x\n", x);
+	}
     }
+    memhex32_image_free (& image);
 
     return 0;
 }
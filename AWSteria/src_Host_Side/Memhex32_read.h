@@ -1,6 +1,8 @@
 #pragma once
 
 // ================================================================
+// Read mem-hex32 data from file into buf (seen as a byte-addressed
+// mem from addr 0 onwards), and return the addr base and lim as well.
 
 extern
 int memhex32_read (char      *filename,
@@ -10,3 +12,38 @@ int memhex32_read (char      *filename,
 		   uint64_t  *p_addr_lim);
 
 // ================================================================
+// Sparse memory image read from a mem-hex32 file: a list of extents
+// (contiguous runs of bytes), in file order.  If the file writes an
+// address more than once, a later extent overrides an earlier one.
+
+typedef struct {
+    uint64_t   addr;        // byte address of data [0]
+    uint64_t   size;        // # of bytes
+    uint8_t   *data;
+} Memhex32_Extent;
+
+typedef struct {
+    uint64_t          n_extents;
+    Memhex32_Extent  *extents;
+    uint64_t          addr_base;    // min addr over all extents
+    uint64_t          addr_lim;     // max addr+size over all extents
+} Memhex32_Image;
+
+// ================================================================
+// Read a mem-hex32 file into a sparse image.
+// The file is mmap'd; large files are parsed in chunks on n_threads
+// threads (0: one per CPU, up to a max).
+// Returns 0 if ok, 1 if error.
+
+extern
+int memhex32_read_image (const char      *filename,
+			 int              n_threads,
+			 Memhex32_Image  *p_image);
+
+// ================================================================
+// Free the extents of an image
+
+extern
+void memhex32_image_free (Memhex32_Image  *p_image);
+
+// ================================================================
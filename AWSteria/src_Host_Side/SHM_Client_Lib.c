@@ -0,0 +1,285 @@
+// Copyright (c) 2020 Bluespec, Inc.  All Rights Reserved
+
+// ================================================================
+// Client communications over shared memory
+
+// Sends and receives bytevecs over a pair of shared-memory rings
+// (see SHM_Ring.h) to/from the simulation server.
+
+// ================================================================
+// C lib includes
+
+// General
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+
+// For shared memory
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+// ----------------
+// Project includes
+
+#include "SHM_Ring.h"
+#include "SHM_Client_Lib.h"
+
+// ================================================================
+// The mapped segment and its two rings
+
+static SHM_Segment_Hdr *p_shm_hdr      = NULL;
+static uint64_t         shm_size       = 0;
+static SHM_Ring        *p_ring_to_sim   = NULL;    // C to BSV
+static SHM_Ring        *p_ring_from_sim = NULL;    // BSV to C
+
+// Give up if a segment is not initialized within this time
+#define SHM_OPEN_TIMEOUT_MS  10000
+
+static
+void shm_client_unmap (void)
+{
+    munmap (p_shm_hdr, shm_size);
+    p_shm_hdr = NULL;
+}
+
+// ----------------
+// Called in each iteration of a wait on a ring; every
+// SHM_LIVENESS_CHECK_SPINS iterations (counted across calls, since
+// shm_client_wait is called repeatedly with short timeouts), check that
+// the server is still running.  Returns false if it has exited.
+
+static uint64_t n_wait_spins = 0;
+
+static
+bool shm_server_alive (void)
+{
+    n_wait_spins++;
+    if ((n_wait_spins % SHM_LIVENESS_CHECK_SPINS) != 0)
+	return true;
+    if (shm_pid_alive (p_shm_hdr->server_pid))
+	return true;
+    fprintf (stderr, "shm_client: server pid %0ld has exited\n", p_shm_hdr->server_pid);
+    return false;
+}
+
+// ================================================================
+// Open the shared-memory segment created by the simulation server.
+// Return status_err or status_ok.
+
+uint32_t  shm_client_open (const char *shm_name)
+{
+    if (shm_name == NULL) {
+	fprintf (stderr, "shm_client_open (): shm_name is NULL\n");
+	return status_err;
+    }
+
+    char path [256];
+    snprintf (path, sizeof (path), "%s%s", SHM_DIR, shm_name);
+
+    fprintf (stdout, "shm_client_open: connecting to '%s'\n", path);
+
+    // Wait for the server to create the segment
+    int fd;
+    while (true) {
+	fd = open (path, O_RDWR);
+	if (fd >= 0) break;
+	if (errno != ENOENT) {
+	    fprintf (stderr, "shm_client_open (): Error opening '%s'\n", path);
+	    return status_err;
+	}
+	usleep (1000);
+    }
+
+    // Wait for the server to size the segment
+    struct stat st;
+    int n_waits = 0;
+    while (true) {
+	if (fstat (fd, & st) < 0) {
+	    fprintf (stderr, "shm_client_open (): Error in fstat ()\n");
+	    close (fd);
+	    return status_err;
+	}
+	if (st.st_size >= sizeof (SHM_Segment_Hdr)) break;
+	if (n_waits >= SHM_OPEN_TIMEOUT_MS) {
+	    fprintf (stderr, "shm_client_open (): '%s' was not sized by the server\n", path);
+	    close (fd);
+	    return status_err;
+	}
+	usleep (1000);
+	n_waits++;
+    }
+
+    shm_size = st.st_size;
+    p_shm_hdr = (SHM_Segment_Hdr *) mmap (NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (p_shm_hdr == MAP_FAILED) {
+	fprintf (stderr, "shm_client_open (): Error in mmap ()\n");
+	p_shm_hdr = NULL;
+	return status_err;
+    }
+
+    // Wait for the server to initialize the rings.  The segment may be
+    // stale (left by a server that has exited): give up if its server is
+    // not running, or if it is not initialized in time.
+    n_waits = 0;
+    while (__atomic_load_n (& p_shm_hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC) {
+	uint64_t server_pid = __atomic_load_n (& p_shm_hdr->server_pid, __ATOMIC_RELAXED);
+	if (! shm_pid_alive (server_pid)) {
+	    fprintf (stderr, "shm_client_open (): server pid %0ld is not running\n", server_pid);
+	    shm_client_unmap ();
+	    return status_err;
+	}
+	if (n_waits >= SHM_OPEN_TIMEOUT_MS) {
+	    fprintf (stderr, "shm_client_open (): '%s' was not initialized by the server\n", path);
+	    shm_client_unmap ();
+	    return status_err;
+	}
+	usleep (1000);
+	n_waits++;
+    }
+
+    if (shm_segment_size (p_shm_hdr->ring_size) != shm_size) {
+	fprintf (stderr, "shm_client_open (): segment size %0ld inconsistent with ring size %0ld\n",
+		 shm_size, p_shm_hdr->ring_size);
+	shm_client_unmap ();
+	return status_err;
+    }
+
+    // Check that the server is still alive (the segment may be stale)
+    if (! shm_pid_alive (p_shm_hdr->server_pid)) {
+	fprintf (stderr, "shm_client_open (): server pid %0ld is not running\n",
+		 p_shm_hdr->server_pid);
+	shm_client_unmap ();
+	return status_err;
+    }
+
+    p_ring_to_sim   = shm_segment_ring_C_to_BSV (p_shm_hdr);
+    p_ring_from_sim = shm_segment_ring_BSV_to_C (p_shm_hdr);
+
+    p_shm_hdr->client_pid = getpid ();
+    __atomic_store_n (& p_shm_hdr->client_connected, 1, __ATOMIC_RELEASE);
+
+    fprintf (stdout, "shm_client_open: connected\n");
+    return status_ok;
+}
+
+// ================================================================
+// Close the connection to the simulation server.
+
+uint32_t  shm_client_close (uint32_t dummy)
+{
+    if (p_shm_hdr != NULL)
+	shm_client_unmap ();
+    return  status_ok;
+}
+
+// ================================================================
+// Send a message
+// Blocks while the ring is full.
+// Return status_ok, or status_err if the server has exited.
+
+uint32_t  shm_client_send (const uint32_t data_size, const char *data)
+{
+    uint64_t n_sent = 0;
+    while (n_sent < data_size) {
+	n_sent += shm_ring_put (p_ring_to_sim,
+				(const uint8_t *) (data + n_sent),
+				data_size - n_sent);
+	if (n_sent < data_size) {
+	    if (! shm_server_alive ())
+		return status_err;
+	    sched_yield ();
+	}
+    }
+    return status_ok;
+}
+
+// ================================================================
+// Recv a message
+// Return status_ok, status_unavail (no input data available)
+// or status_err (the server has exited)
+
+uint32_t  shm_client_recv (bool do_poll, const uint32_t data_size, char *data)
+{
+    if (do_poll && (shm_ring_used (p_ring_from_sim) == 0))
+	return status_unavail;
+
+    uint64_t n_recd = 0;
+    while (n_recd < data_size) {
+	n_recd += shm_ring_get (p_ring_from_sim,
+				(uint8_t *) (data + n_recd),
+				data_size - n_recd);
+	if (n_recd < data_size) {
+	    if (! shm_server_alive ())
+		return status_err;
+	    sched_yield ();
+	}
+    }
+    return status_ok;
+}
+
+// ================================================================
+// Recv whatever data is available, up to max_size bytes, without blocking
+// Return status_ok (*p_n_recd = # of bytes received)
+// or status_unavail (no input data available)
+
+uint32_t  shm_client_recv_avail (const uint32_t max_size, char *data, uint32_t *p_n_recd)
+{
+    *p_n_recd = shm_ring_get (p_ring_from_sim, (uint8_t *) data, max_size);
+    return ((*p_n_recd == 0) ? status_unavail : status_ok);
+}
+
+// ================================================================
+// Wait until input data is available or timeout_ms milliseconds elapse
+// (negative: wait indefinitely).
+// There is no kernel object to block on, so this yields for a while
+// and then sleeps with exponential backoff (1 us doubling to 1 ms).
+// Return status_ok (data available), status_unavail (timed out)
+// or status_err (the server has exited)
+
+#define SHM_WAIT_YIELDS        100
+#define SHM_WAIT_MAX_SLEEP_NS  1000000
+
+uint32_t  shm_client_wait (int timeout_ms)
+{
+    struct timespec  t_start, t_now, t_sleep;
+    clock_gettime (CLOCK_MONOTONIC, & t_start);
+
+    uint64_t sleep_ns = 1000;
+    for (int j = 0; ; j++) {
+	if (shm_ring_used (p_ring_from_sim) != 0)
+	    return status_ok;
+
+	if (! shm_server_alive ())
+	    return status_err;
+
+	if (timeout_ms >= 0) {
+	    clock_gettime (CLOCK_MONOTONIC, & t_now);
+	    int64_t elapsed_ns = ((int64_t) (t_now.tv_sec - t_start.tv_sec) * 1000000000
+				  + (t_now.tv_nsec - t_start.tv_nsec));
+	    if (elapsed_ns >= ((int64_t) timeout_ms * 1000000))
+		return status_unavail;
+	}
+
+	if (j < SHM_WAIT_YIELDS)
+	    sched_yield ();
+	else {
+	    t_sleep.tv_sec  = 0;
+	    t_sleep.tv_nsec = sleep_ns;
+	    nanosleep (& t_sleep, NULL);
+	    if (sleep_ns < SHM_WAIT_MAX_SLEEP_NS)
+		sleep_ns = sleep_ns * 2;
+	}
+    }
+}
+
+// ================================================================
@@ -0,0 +1,55 @@
+// Copyright (c) 2020 Bluespec, Inc.  All Rights Reserved
+
+// ================================================================
+// Client communications over shared memory
+
+// Sends and receives bytevecs over a pair of shared-memory rings
+// (see SHM_Ring.h) to/from the simulation server.  Same API and
+// status codes as TCP_Client_Lib.
+
+// ================================================================
+
+#pragma once
+
+#include "TCP_Client_Lib.h"
+
+// ================================================================
+// Open the shared-memory segment /dev/shm/<shm_name> created by the
+// simulation server (waits for the server to create it).
+
+extern
+uint32_t  shm_client_open (const char *shm_name);
+
+// ================================================================
+// Close the connection to the simulation server.
+
+extern
+uint32_t  shm_client_close (uint32_t dummy);
+
+// ================================================================
+// Send a message
+
+extern
+uint32_t  shm_client_send (const uint32_t data_size, const char *data);
+
+// ================================================================
+// Recv a message
+
+extern
+uint32_t  shm_client_recv (bool poll, const uint32_t data_size, char *data);
+
+// ================================================================
+// Recv whatever data is available, up to max_size bytes, without blocking
+
+extern
+uint32_t  shm_client_recv_avail (const uint32_t max_size, char *data, uint32_t *p_n_recd);
+
+// ================================================================
+// Wait until input data is available or timeout_ms milliseconds elapse
+// (negative: wait indefinitely).  This polls the ring with a sleep
+// backoff, so it may return up to 1 ms after data arrives.
+
+extern
+uint32_t  shm_client_wait (int timeout_ms);
+
+// ================================================================
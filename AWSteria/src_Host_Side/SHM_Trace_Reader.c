@@ -0,0 +1,178 @@
+// Copyright (c) 2020 Bluespec, Inc.  All Rights Reserved
+
+// ================================================================
+// Trace reader for a live Tandem Verification checker
+
+// Reads the trace streamed by the simulation over a shared-memory ring
+// (see SHM_Ring.h).  The simulation stalls while the ring is full, so
+// the checker sets the pace.  Each side checks that the other is still
+// running (server_pid, client_pid) while it waits on the ring.
+
+// ================================================================
+// C lib includes
+
+// General
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sched.h>
+
+// For shared memory
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+// ----------------
+// Project includes
+
+#include "SHM_Ring.h"
+#include "SHM_Trace_Reader.h"
+
+// ================================================================
+// The mapped segment and its ring
+
+static SHM_Segment_Hdr *p_trace_hdr  = NULL;
+static uint64_t         trace_size   = 0;
+static SHM_Ring        *p_trace_ring = NULL;
+
+// ================================================================
+// Called in each iteration of a wait on the ring; every
+// SHM_LIVENESS_CHECK_SPINS iterations, check that the simulation is
+// still running (if it crashed, server_done is never set).
+
+static uint64_t n_wait_spins = 0;
+
+static
+bool shm_trace_server_alive (void)
+{
+    n_wait_spins++;
+    if ((n_wait_spins % SHM_LIVENESS_CHECK_SPINS) != 0)
+	return true;
+    if (shm_pid_alive (p_trace_hdr->server_pid))
+	return true;
+    fprintf (stderr, "shm_trace: simulation pid %0ld has exited\n", p_trace_hdr->server_pid);
+    return false;
+}
+
+// ================================================================
+// Open the trace segment created by the simulation.
+// Return status_err or status_ok.
+
+uint32_t  shm_trace_open (const char *shm_name)
+{
+    if (shm_name == NULL) {
+	fprintf (stderr, "shm_trace_open (): shm_name is NULL\n");
+	return status_err;
+    }
+
+    char path [256];
+    snprintf (path, sizeof (path), "%s%s", SHM_DIR, shm_name);
+
+    fprintf (stdout, "shm_trace_open: connecting to '%s'\n", path);
+
+    // Wait for the simulation to create and size the segment
+    int fd;
+    while (true) {
+	fd = open (path, O_RDWR);
+	if (fd >= 0) break;
+	if (errno != ENOENT) {
+	    fprintf (stderr, "shm_trace_open (): Error opening '%s'\n", path);
+	    return status_err;
+	}
+	usleep (1000);
+    }
+
+    struct stat st;
+    while (true) {
+	if (fstat (fd, & st) < 0) {
+	    fprintf (stderr, "shm_trace_open (): Error in fstat ()\n");
+	    close (fd);
+	    return status_err;
+	}
+	if (st.st_size >= sizeof (SHM_Segment_Hdr)) break;
+	usleep (1000);
+    }
+
+    trace_size  = st.st_size;
+    p_trace_hdr = (SHM_Segment_Hdr *) mmap (NULL, trace_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (p_trace_hdr == MAP_FAILED) {
+	fprintf (stderr, "shm_trace_open (): Error in mmap ()\n");
+	p_trace_hdr = NULL;
+	return status_err;
+    }
+
+    // Wait for the simulation to initialize the ring
+    uint64_t magic;
+    while ((magic = __atomic_load_n (& p_trace_hdr->magic, __ATOMIC_ACQUIRE)) == 0)
+	usleep (1000);
+
+    if ((magic != SHM_TRACE_MAGIC)
+	|| (shm_trace_segment_size (p_trace_hdr->ring_size) != trace_size)) {
+	fprintf (stderr, "shm_trace_open (): '%s' is not a trace segment\n", path);
+	return status_err;
+    }
+
+    p_trace_ring = shm_trace_segment_ring (p_trace_hdr);
+
+    // Publish our pid before 'connected', for the simulation's liveness checks
+    p_trace_hdr->client_pid = getpid ();
+    __atomic_store_n (& p_trace_hdr->client_connected, 1, __ATOMIC_RELEASE);
+
+    fprintf (stdout, "shm_trace_open: connected\n");
+    return status_ok;
+}
+
+// ================================================================
+// Close the trace segment.
+
+uint32_t  shm_trace_close (uint32_t dummy)
+{
+    if (p_trace_hdr != NULL) {
+	munmap (p_trace_hdr, trace_size);
+	p_trace_hdr = NULL;
+    }
+    return  status_ok;
+}
+
+// ================================================================
+// Recv whatever data is available, up to max_size bytes, without blocking
+
+uint32_t  shm_trace_recv_avail (const uint32_t max_size, char *data, uint32_t *p_n_recd)
+{
+    // Read 'done' before the ring, so no data published before it is missed
+    bool done  = (__atomic_load_n (& p_trace_hdr->server_done, __ATOMIC_ACQUIRE) != 0);
+
+    *p_n_recd = shm_ring_get (p_trace_ring, (uint8_t *) data, max_size);
+    if (*p_n_recd != 0)
+	return status_ok;
+    return (done ? status_eof : status_unavail);
+}
+
+// ================================================================
+// Recv exactly data_size bytes, waiting as necessary.
+
+uint32_t  shm_trace_recv (const uint32_t data_size, char *data)
+{
+    uint32_t n_recd = 0;
+    while (n_recd < data_size) {
+	uint32_t n;
+	uint32_t status = shm_trace_recv_avail (data_size - n_recd, data + n_recd, & n);
+	if (status == status_eof)
+	    return status_eof;
+	n_recd += n;
+	if (status == status_unavail) {
+	    if (! shm_trace_server_alive ())
+		return status_err;
+	    sched_yield ();
+	}
+    }
+    return status_ok;
+}
+
+// ================================================================
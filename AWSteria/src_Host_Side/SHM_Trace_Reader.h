@@ -0,0 +1,49 @@
+// Copyright (c) 2020 Bluespec, Inc.  All Rights Reserved
+
+// ================================================================
+// Trace reader for a live Tandem Verification checker
+
+// Reads the trace streamed by the simulation over a shared-memory ring
+// (see SHM_Ring.h), when the simulation is run with env var
+// AWSTERIA_TRACE_SHM=<name>.  The byte stream is the same as the
+// contents of trace_out.dat.  Status codes as in TCP_Client_Lib.
+
+// ================================================================
+
+#pragma once
+
+#include "TCP_Client_Lib.h"
+
+// The simulation has closed the trace, and all of it has been read
+#define   status_eof      3
+
+// ================================================================
+// Open the trace segment /dev/shm/<shm_name> created by the simulation
+// (waits for the simulation to create it).
+
+extern
+uint32_t  shm_trace_open (const char *shm_name);
+
+// ================================================================
+// Close the trace segment.
+
+extern
+uint32_t  shm_trace_close (uint32_t dummy);
+
+// ================================================================
+// Recv exactly data_size bytes, waiting as necessary.
+// Return status_ok, status_eof if the trace ends first, or status_err
+// if the simulation exits without closing the trace.
+
+extern
+uint32_t  shm_trace_recv (const uint32_t data_size, char *data);
+
+// ================================================================
+// Recv whatever data is available, up to max_size bytes, without blocking
+// Return status_ok (*p_n_recd = # of bytes received), status_unavail
+// (no data available yet) or status_eof.
+
+extern
+uint32_t  shm_trace_recv_avail (const uint32_t max_size, char *data, uint32_t *p_n_recd);
+
+// ================================================================
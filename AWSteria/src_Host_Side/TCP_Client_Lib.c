@@ -161,3 +161,51 @@ uint32_t  tcp_client_recv (bool do_poll, const uint32_t data_size, char *data)
 }
 
 // ================================================================
+// Recv whatever data is available, up to max_size bytes, without blocking
+// Return status_ok (*p_n_recd = # of bytes received)
+// or status_unavail (no input data available)
+
+uint32_t  tcp_client_recv_avail (const uint32_t max_size, char *data, uint32_t *p_n_recd)
+{
+    *p_n_recd = 0;
+
+    int n = recv (sockfd, data, max_size, MSG_DONTWAIT);
+    if (n < 0) {
+	if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+	    return status_unavail;
+	fprintf (stdout, "ERROR: tcp_client_recv_avail (): recv () failed\n");
+	exit (1);
+    }
+    else if (n == 0) {
+	fprintf (stdout, "ERROR: tcp_client_recv_avail (): connection closed by server\n");
+	exit (1);
+    }
+    *p_n_recd = n;
+    return status_ok;
+}
+
+// ================================================================
+// Wait until input data is available or timeout_ms milliseconds elapse
+// (negative: wait indefinitely).
+// Return status_ok (data available) or status_unavail (timed out)
+
+uint32_t  tcp_client_wait (int timeout_ms)
+{
+    struct pollfd  x_pollfd;
+    x_pollfd.fd      = sockfd;
+    x_pollfd.events  = POLLRDNORM;
+    x_pollfd.revents = 0;
+
+    int n = poll (& x_pollfd, 1, timeout_ms);
+
+    if ((n < 0) && (errno != EINTR)) {
+	fprintf (stdout, "ERROR: tcp_client_wait (): poll () failed\n");
+	exit (1);
+    }
+
+    if ((n <= 0) || ((x_pollfd.revents & (POLLRDNORM | POLLHUP | POLLERR)) == 0))
+	return status_unavail;
+    return status_ok;
+}
+
+// ================================================================
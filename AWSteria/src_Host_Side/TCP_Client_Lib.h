@@ -7,6 +7,8 @@
 
 // ================================================================
 
+#pragma once
+
 #define   status_err      0
 #define   status_ok       1
 #define   status_unavail  2
@@ -37,3 +39,16 @@ extern
 uint32_t  tcp_client_recv (bool poll, const uint32_t data_size, char *data);
 
 // ================================================================
+// Recv whatever data is available, up to max_size bytes, without blocking
+
+extern
+uint32_t  tcp_client_recv_avail (const uint32_t max_size, char *data, uint32_t *p_n_recd);
+
+// ================================================================
+// Wait until input data is available or timeout_ms milliseconds elapse
+// (negative: wait indefinitely).
+
+extern
+uint32_t  tcp_client_wait (int timeout_ms);
+
+// ================================================================
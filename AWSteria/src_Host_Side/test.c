@@ -9,6 +9,9 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <elf.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "test_dram_dma_common.h"
 #include "AWS_Sim_Lib.h"
@@ -30,10 +33,15 @@ static inline int do_dma_write(int fd, uint8_t *buffer, size_t size,
 static const char this_file_name [] = "test.c";
 
 #include "Memhex32_read.h"
+#include "Elf_Segments.h"
+#include "Elf_Loader.h"
+#include "Mem_Snapshot.h"
 
-int start_hw ();
+int start_hw (bool resume);
 
 int load_mem_hex32_using_DMA (int slot_id, char *filename);
+bool file_is_elf (const char *filename);
+bool preload_confirmed (const char *preload_filename, const char *restore_filename);
 
 // ****************************************************************
 
@@ -61,6 +69,17 @@ int main(int argc, char **argv)
 
     AWS_Sim_Lib_init ();
 
+    // If env var AWSTERIA_RESUME is set (non-empty), the simulation was
+    // started from a checkpoint (+restore=<file>) and its CPU is already
+    // running: do not touch DDR4 (no DMA example, no download) and do
+    // not repeat the startup sequence; just attach to the console.
+    char *resume_str = getenv ("AWSTERIA_RESUME");
+    bool  resume     = ((resume_str != NULL) && (resume_str [0] != 0));
+    if (resume) {
+	fprintf (stdout, "%s: resuming a restored simulation (AWSTERIA_RESUME)\n", this_file_name);
+	goto start;
+    }
+
     // ================================================================
     // Exercise the DMA to see if it's working
 
@@ -73,21 +92,74 @@ int main(int argc, char **argv)
     // ================================================================
     // AWSteria code
 
+    // If env var AWSTERIA_PRELOAD or AWSTERIA_DDR_RESTORE is set, the
+    // simulation loads its DDR4 models itself: skip the download once a
+    // read-back confirms it (a simulator built from RTL that predates the
+    // preload leaves DDR4 empty; then download the preload file instead).
+    // Else if env var AWSTERIA_ELF names an ELF file, load it directly;
+    // otherwise load the Mem-hex32 file.
     // TODO: get the filename from command-line args/config file/...
     // char memhex32_filename [] = "Mem.hex";
     char memhex32_filename[] = "Mem.hex";
+    char *preload_filename = getenv ("AWSTERIA_PRELOAD");
+    char *restore_filename = getenv (MEM_RESTORE_ENV_VAR);
+    char *elf_filename = getenv ("AWSTERIA_ELF");
+    char *load_filename = ((elf_filename != NULL) ? elf_filename : memhex32_filename);
+    bool  load_elf      = (elf_filename != NULL);
+    bool  preloaded     = false;
+
+    if ((preload_filename != NULL) && (preload_filename [0] == 0))
+	preload_filename = NULL;
+    if ((restore_filename != NULL) && (restore_filename [0] == 0))
+	restore_filename = NULL;
+
+    if ((preload_filename != NULL) || (restore_filename != NULL)) {
+	preloaded = preload_confirmed (preload_filename, restore_filename);
+	if (preloaded) {
+	    fprintf (stdout, "%s: DDR4 preloaded by simulation from %s; skipping download\n",
+		     this_file_name, ((preload_filename != NULL) ? preload_filename : restore_filename));
+	}
+	else if (preload_filename != NULL) {
+	    fprintf (stdout, "%s: simulation did not preload DDR4 from %s; downloading it\n",
+		     this_file_name, preload_filename);
+	    load_filename = preload_filename;
+	    load_elf      = file_is_elf (preload_filename);
+	}
+	else {
+	    fprintf (stdout, "%s: ERROR: simulation did not restore DDR4 from %s\n",
+		     this_file_name, restore_filename);
+	    fprintf (stdout, "    (was the simulator rebuilt from current RTL?)\n");
+	    rc = 1;
+	    goto out;
+	}
+    }
 
-    rc = load_mem_hex32_using_DMA (slot_id, memhex32_filename);
-    if (rc != 0) {
-	fprintf (stdout, "Loading the mem hex32 file failed\n");
-	goto out;
+    if (preloaded) {
+	// nothing to download
+    }
+    else if (load_elf) {
+	Elf_Features  elf_features;
+	fprintf (stdout, "%s: Loading ELF file using DMA: %s\n", this_file_name, load_filename);
+	rc = elf_load_using_DMA (-1, load_filename, & elf_features);
+	if (rc != 0) {
+	    fprintf (stdout, "Loading the ELF file failed\n");
+	    goto out;
+	}
+    }
+    else {
+	rc = load_mem_hex32_using_DMA (slot_id, load_filename);
+	if (rc != 0) {
+	    fprintf (stdout, "Loading the mem hex32 file failed\n");
+	    goto out;
+	}
     }
 
     // ================================================================
     // AWSteria code
 
+ start:
     // Start the hardware
-    rc = start_hw ();
+    rc = start_hw (resume);
     if (rc != 0) {
 	fprintf (stdout, "starting the HW failed");
 	goto out;
@@ -226,42 +298,33 @@ static inline int do_dma_write (int fd, uint8_t *buffer, size_t size,
 // ================================================================
 // Load memory using DMA
 
-#define BUF_SIZE 0x200000000llu
-
 int load_mem_hex32_using_DMA (int slot_id, char *filename)
 {
     int write_fd, read_fd, rc;
     int channel = 0;
+    uint8_t *read_buffer = NULL;
 
-    fprintf (stdout, "%s: Reading Mem Hex32 file into local buffer: %s\n",
+    fprintf (stdout, "%s: Reading Mem Hex32 file into sparse image: %s\n",
 	     this_file_name, filename);
 
-    // Allocate a buffer to read memhex contents
-    uint8_t *buf = (uint8_t *) malloc  (BUF_SIZE);
-    if (buf == NULL) {
-	fprintf (stdout, "%s: ERROR allocating memhex buffer of size: %0lld (0x%0llx)\n",
-		 this_file_name, BUF_SIZE, BUF_SIZE);
-	rc = 1;
-	goto out;
-    }
-
-    // Read the memhex file
-    uint64_t  addr_base, addr_lim;
-    rc = memhex32_read (filename, buf, BUF_SIZE, & addr_base, & addr_lim);
+    // Read the memhex file (only the populated extents are kept in memory)
+    Memhex32_Image  image;
+    rc = memhex32_read_image (filename, 0, & image);
     if (rc != 0) {
 	fprintf (stdout, "%s: ERROR reading Mem_hex32 file: %s\n", this_file_name, filename);
 	rc = 1;
 	goto out;
     }
+    uint64_t  addr_base = image.addr_base;
+    uint64_t  addr_lim  = image.addr_lim;
     fprintf (stdout, "Mem_hex32 file read ok.\n");
-    fprintf (stdout, "    addr_base 0x%0lx  addr_lim 0x%0lx (%0ld bytes)\n",
-	     addr_base, addr_lim, addr_lim - addr_base);
-    if (addr_base >= addr_lim) {
+    fprintf (stdout, "    addr_base 0x%0lx  addr_lim 0x%0lx (%0ld bytes) in %0ld extents\n",
+	     addr_base, addr_lim, addr_lim - addr_base, image.n_extents);
+    if (image.n_extents == 0) {
 	fprintf (stdout, "    But this is empty! Abandoning download\n");
 	rc = 1;
 	goto out;
     }
-    uint64_t download_size = addr_lim - addr_base;
 
     // ================
     // Prep for DMA write and read
@@ -271,60 +334,42 @@ int load_mem_hex32_using_DMA (int slot_id, char *filename)
 
     // Allocate a read buffer, just for read-back sanity check on first 128 bytes.
     size_t buffer_size = 128;
-    uint8_t *read_buffer = malloc (buffer_size);
+    read_buffer = malloc (buffer_size);
     if (read_buffer == NULL) {
         rc = -ENOMEM;
         goto out;
     }
 
     // ================
-    // Download to DDR4:
-    // - in chunks that do not cross 4K boundaries
-    // - destination addrs must be 64-byte aligned
+    // Download to DDR4, extent by extent
+    // (fpga_dma_write splits into 4KB-bounded bursts and pipelines them)
 
-    uint8_t *dma_buf;
-    rc = posix_memalign ((void **) (& dma_buf), 0x1000, 0x1000);    // 4KB buffer, 4KB aligned
-    if (rc != 0) {
-	fprintf (stdout, "%s: ERROR could not allocate 4KB buf with posix_memalign\n", this_file_name);
-	rc = 1;
-	goto out;
-    }
-    fprintf (stdout, "%s: 4KB DMA buffer allocated at %p\n", this_file_name, dma_buf);
-
-    fprintf (stdout, "Downloading to AWS DDR4\n");
-    uint64_t  addr1 = ((addr_base >> 6) << 6);    // 64B aligned (required by AWS)
-    while (addr1 < addr_lim) {
-	int chunk_size = (addr_lim - addr1);
-	if (chunk_size > 0x80) chunk_size = 0x80;    // Trimmed to 4KB if nec'y
-
-	// Copy data to DMA buffer
-	memcpy (dma_buf, & (buf [addr1]), chunk_size);
-
-	// DMA it
-	fprintf (stdout, "%s: DMA %0d bytes to addr 0x%0lx\n", this_file_name, chunk_size, addr1);
-	rc = do_dma_write (write_fd, dma_buf, chunk_size, addr1, channel, slot_id);
+    for (uint64_t j = 0; j < image.n_extents; j++) {
+	Memhex32_Extent *p_ext = & (image.extents [j]);
+	fprintf (stdout, "Downloading %0ld bytes to AWS DDR4 at addr 0x%0lx\n", p_ext->size, p_ext->addr);
+	rc = fpga_dma_write (write_fd, p_ext->data, p_ext->size, p_ext->addr);
 	if (rc != 0) {
-	    fprintf (stdout, "DMA write failed on channel 0\n");
+	    fprintf (stdout, "DMA write failed on channel %0d\n", channel);
 	    goto out;
 	}
-	addr1 += chunk_size;
     }
 
     // ================
-    // Readback up to 128 bytes and cross-check
-    size_t read_size = ((download_size <= 128) ? download_size : 128);
+    // Readback up to 128 bytes of the first extent and cross-check
+    // (a later extent may have overwritten it, if the file re-visits addresses)
+    Memhex32_Extent *p_ext0 = & (image.extents [0]);
+    size_t read_size = ((p_ext0->size <= buffer_size) ? p_ext0->size : buffer_size);
     fprintf (stdout, "Reading back %0ld bytes to spot-check the download\n", read_size);
-    addr1 = ((addr_base >> 6) << 6);    // 64B aligned (required by AWS)
-    rc = do_dma_read (read_fd, dma_buf, read_size, addr1, channel, slot_id);
+    rc = fpga_dma_read (read_fd, read_buffer, read_size, p_ext0->addr);
     if (rc != 0) {
-	fprintf (stdout, "DMA read failed on channel 0");
+	fprintf (stdout, "DMA read failed on channel %0d\n", channel);
 	goto out;
     }
 
     fprintf (stdout, "Checking readback-data of %0ld bytes ...\n", read_size);
     for (uint64_t j = 0; j < read_size; j += 4) {
-	uint32_t *p1 = (uint32_t *) (buf + addr1 + j);
-	uint32_t *p2 = (uint32_t *) (dma_buf + j);
+	uint32_t *p1 = (uint32_t *) (p_ext0->data + j);
+	uint32_t *p2 = (uint32_t *) (read_buffer + j);
 	if (*p1 != *p2) {
 	    fprintf (stdout, "%s: read-back of mem data differs at addr %0lx\n", this_file_name, j);
 	    fprintf (stdout, "    Original  word: 0x%08x\n", *p1);
@@ -340,6 +385,7 @@ out:
     if (read_buffer != NULL) {
         free(read_buffer);
     }
+    memhex32_image_free (& image);
 #if !defined(SV_TEST)
     if (write_fd >= 0) {
         close(write_fd);
@@ -352,6 +398,161 @@ out:
     return (rc != 0 ? 1 : 0);
 }
 
+// ================================================================
+// Confirm that the simulation has preloaded (or restored) its DDR4
+// models, by reading back up to PRELOAD_CHECK_SIZE bytes of non-zero
+// data from the preload file (else the first page of the snapshot)
+// and comparing.  Leading zero bytes are skipped, since DDR4 that
+// was never loaded also reads as zero.
+
+#define PRELOAD_CHECK_SIZE  4096
+
+typedef struct {
+    bool      found;
+    uint64_t  addr;
+    uint8_t   data [PRELOAD_CHECK_SIZE];
+    uint64_t  size;
+} Preload_Window;
+
+// Take the window from the first non-zero word of p_data [0..size-1], if not yet found
+static
+void preload_window_set (Preload_Window *p_w, uint64_t addr, const uint8_t *p_data, uint64_t size)
+{
+    if (p_w->found)
+	return;
+    uint64_t j = 0;
+    while ((j < size) && (p_data [j] == 0))
+	j++;
+    j &= (~ ((uint64_t) 0x3));
+    if (j >= size)
+	return;
+    p_w->found = true;
+    p_w->addr  = addr + j;
+    p_w->size  = min (size - j, PRELOAD_CHECK_SIZE);
+    memcpy (p_w->data, p_data + j, p_w->size);
+}
+
+static
+int preload_window_segment (uint64_t seg_num, uint64_t paddr, const uint8_t *p_data,
+			    uint64_t filesz, uint64_t memsz, void *arg)
+{
+    preload_window_set ((Preload_Window *) arg, paddr, p_data, filesz);
+    return 0;
+}
+
+bool file_is_elf (const char *filename)
+{
+    uint8_t ident [SELFMAG];
+    FILE *fp = fopen (filename, "r");
+    if (fp == NULL)
+	return false;
+    bool is_elf = ((fread (ident, SELFMAG, 1, fp) == 1) && (memcmp (ident, ELFMAG, SELFMAG) == 0));
+    fclose (fp);
+    return is_elf;
+}
+
+// Find the window in an ELF or Mem-hex32 preload file.  Returns 0 if ok.
+static
+int preload_window_from_file (const char *filename, Preload_Window *p_w)
+{
+    if (file_is_elf (filename)) {
+	int fd = open (filename, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat (fd, & st) < 0)) {
+	    fprintf (stdout, "ERROR: preload_confirmed: could not open: %s\n", filename);
+	    if (fd >= 0) close (fd);
+	    return 1;
+	}
+	uint64_t file_size = st.st_size;
+	const uint8_t *p_file = (const uint8_t *) mmap (NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (p_file == MAP_FAILED) {
+	    fprintf (stdout, "ERROR: preload_confirmed: could not mmap: %s\n", filename);
+	    return 1;
+	}
+	Elf_Hdr_Info hdr;
+	int rc = ((elf_read_hdr ("preload_confirmed", filename, p_file, file_size, & hdr) != 0)
+		  || (elf_for_each_load_segment ("preload_confirmed", filename, p_file, file_size,
+						 & hdr, preload_window_segment, p_w) != 0));
+	munmap ((void *) p_file, file_size);
+	return rc;
+    }
+    else {
+	// Later extents override earlier ones, so search from the last one
+	Memhex32_Image image;
+	if (memhex32_read_image (filename, 0, & image) != 0)
+	    return 1;
+	for (uint64_t j = image.n_extents; j > 0; j--)
+	    preload_window_set (p_w, image.extents [j-1].addr, image.extents [j-1].data, image.extents [j-1].size);
+	memhex32_image_free (& image);
+	return 0;
+    }
+}
+
+// Find the window in the first page of a DDR4 snapshot.  Returns 0 if ok.
+static
+int preload_window_from_snapshot (const char *filename, Preload_Window *p_w)
+{
+    Mem_Snapshot_Hdr   hdr;
+    Mem_Snapshot_Entry entry;
+    uint8_t            page [PRELOAD_CHECK_SIZE];
+    int                rc = 1;
+
+    FILE *fp = fopen (filename, "r");
+    if (fp == NULL) {
+	fprintf (stdout, "ERROR: preload_confirmed: could not open: %s\n", filename);
+	return 1;
+    }
+    if ((fread (& hdr, sizeof (hdr), 1, fp) != 1)
+	|| (memcmp (hdr.magic, MEM_SNAPSHOT_MAGIC, sizeof (hdr.magic)) != 0)
+	|| (hdr.version != MEM_SNAPSHOT_VERSION)) {
+	fprintf (stdout, "ERROR: preload_confirmed: not a DDR4 snapshot file: %s\n", filename);
+	goto done;
+    }
+    rc = 0;
+    if (hdr.n_pages == 0)
+	goto done;
+    uint64_t size = min (hdr.page_size, PRELOAD_CHECK_SIZE);
+    if ((fread (& entry, sizeof (entry), 1, fp) != 1)
+	|| (fseek (fp, hdr.data_offset, SEEK_SET) != 0)
+	|| (fread (page, size, 1, fp) != 1)) {
+	fprintf (stdout, "ERROR: preload_confirmed: truncated DDR4 snapshot file: %s\n", filename);
+	rc = 1;
+	goto done;
+    }
+    preload_window_set (p_w, (entry.ddr4_num * MEM_16G) + entry.byte_offset, page, size);
+
+ done:
+    fclose (fp);
+    return rc;
+}
+
+bool preload_confirmed (const char *preload_filename, const char *restore_filename)
+{
+    Preload_Window w;
+    w.found = false;
+    int rc = ((preload_filename != NULL)
+	      ? preload_window_from_file (preload_filename, & w)
+	      : preload_window_from_snapshot (restore_filename, & w));
+    if (rc != 0)
+	return false;
+    if (! w.found)
+	return true;    // all zero: nothing to tell apart
+
+    uint8_t buf [PRELOAD_CHECK_SIZE];
+    if (fpga_dma_read (-1, buf, w.size, w.addr) != 0) {
+	fprintf (stdout, "ERROR: preload_confirmed: DMA read failed\n");
+	return false;
+    }
+    if (memcmp (buf, w.data, w.size) != 0) {
+	fprintf (stdout, "%s: DDR4 at 0x%0" PRIx64 " (%0" PRId64 " bytes) does not match %s\n",
+		 this_file_name, w.addr, w.size,
+		 ((preload_filename != NULL) ? preload_filename : restore_filename));
+	return false;
+    }
+    return true;
+}
+
 // ================================================================
 // Startup sequence over OCL
 
@@ -474,11 +675,18 @@ int wait_for_chan_avail (uint32_t ocl_addr_base, uint32_t chan)
     return rc;
 }
 
-int start_hw (void)
+int start_hw (bool resume)
 {
     int rc, verbosity = 1;
     uint32_t ocl_addr, ocl_data_to_hw, ocl_data_from_hw;
 
+    // A restored simulation has already been through the startup
+    // sequence (and its CPU may be mid-run): go straight to polling.
+    if (resume) {
+	fprintf (stdout, "Host_side: resuming; skipping CPU setup and 'DDR4 Loaded'\n");
+	goto poll;
+    }
+
     // ----------------
     // Set up CPU verbosity and logdelay
     uint32_t cpu_verbosity = 1;
@@ -545,6 +753,7 @@ int start_hw (void)
     //  - for UART output (and relay it to the console screen)
     // There's no timeout here because HW may never stop (e.g., an executing CPU).
 
+poll:
     fprintf (stdout, "Host_side: Starting polling loop\n");
 
 
@@ -33,17 +33,36 @@
 // For comms polling
 #include <poll.h>
 #include <sched.h>
+#include <pthread.h>
 
 // For TCP
 #include <sys/socket.h>       //  socket definitions
 #include <sys/types.h>        //  socket types
 #include <arpa/inet.h>        //  inet (3) funtions
 #include <fcntl.h>            // To set non-blocking mode
+#include <sys/un.h>           // Unix-domain sockets (telemetry)
+#include <sys/uio.h>          // struct iovec
+
+// For shared-memory comms
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// For memory-model preload
+#include <elf.h>
+
+// For trace file compression
+#include <zlib.h>
 
 // ================================================================
 // Includes for this project
 
 #include "C_Imported_Functions.h"
+#include "SHM_Ring.h"
+#include "Mem_Snapshot.h"
+
+// Shared with the host-side loaders (src_Host_Side)
+#include "Elf_Segments.h"
+#include "Memhex32_read.h"
 
 // ****************************************************************
 // ****************************************************************
@@ -93,6 +112,261 @@ void c_end_timing (uint64_t  cycle_num)
 // ****************************************************************
 // ****************************************************************
 
+// Simulation telemetry
+
+// If env var AWSTERIA_TELEMETRY is set, a line of statistics is emitted
+// every AWSTERIA_TELEMETRY_MS milliseconds (default 1000) while the
+// simulation runs, and once more at exit:
+//     AWSTERIA_TELEMETRY=<file>         write lines to <file> ('-': stdout)
+//     AWSTERIA_TELEMETRY=unix:<path>    serve lines on a Unix-domain
+//                                       stream socket (e.g., 'nc -U <path>')
+// Each line is a sequence of space-separated key=value fields:
+//     t              seconds since the host connected
+//     cycles         simulated cycles
+//     cps            cycles/sec over the last interval
+//     cps_win        cycles/sec over the last TELEMETRY_WINDOW intervals
+//     bdpi           fraction of wall time spent inside the host-comms,
+//                    memory-model and trace BDPI functions
+//     rx<c>, tx<c>   host packets/sec received/sent on channel id <c>
+//     ddr_rd, ddr_wr DDR4 model 64-byte beats/sec read/written
+//     ddr_req        DDR4 timing-model requests (bursts)/sec
+// Cycles are counted by c_host_flush (), which runs every cycle once
+// the host has connected (or by c_host_recv (); see host_flush_called).
+
+#define TELEMETRY_ENV_VAR           "AWSTERIA_TELEMETRY"
+#define TELEMETRY_MS_ENV_VAR        "AWSTERIA_TELEMETRY_MS"
+#define TELEMETRY_UNIX_PREFIX       "unix:"
+#define TELEMETRY_WINDOW            10
+#define TELEMETRY_N_CHANS           8
+#define TELEMETRY_MAX_CLIENTS       8
+#define TELEMETRY_POLL_CYCLES_MASK  0x3FF    // check the clock every 1024 cycles
+
+// Position of the channel id in a bytevec (see Bytevec.c, generated
+// from the AWS_FPGA_Spec): after the size byte and the credit bytes
+#define TELEMETRY_C_TO_BSV_CHAN_BYTE  5
+#define TELEMETRY_BSV_TO_C_CHAN_BYTE  7
+
+typedef struct {
+    uint64_t  t_ns;
+    uint64_t  cycles;
+    uint64_t  bdpi_ns;
+    uint64_t  rx_pkts [TELEMETRY_N_CHANS];
+    uint64_t  tx_pkts [TELEMETRY_N_CHANS];
+    uint64_t  ddr_rd_beats;
+    uint64_t  ddr_wr_beats;
+    uint64_t  ddr_reqs;
+} Telemetry_Counts;
+
+static bool              telemetry_on = false;
+static Telemetry_Counts  telemetry;
+static Telemetry_Counts  telemetry_window [TELEMETRY_WINDOW];    // at ends of recent intervals
+static uint64_t          telemetry_n_intervals = 0;
+static uint64_t          telemetry_t0_ns       = 0;
+static uint64_t          telemetry_interval_ns = 1000000000;
+static FILE             *telemetry_fp          = NULL;
+static int               telemetry_listen_fd   = -1;
+static int               telemetry_client_fds [TELEMETRY_MAX_CLIENTS];
+
+static inline
+uint64_t telemetry_now_ns (void)
+{
+    struct timespec  ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Bracket the body of a BDPI function to account for its wall time
+#define TELEMETRY_BDPI_ENTER  uint64_t telemetry_t_enter = (telemetry_on ? telemetry_now_ns () : 0)
+#define TELEMETRY_BDPI_EXIT   if (telemetry_on) telemetry.bdpi_ns += (telemetry_now_ns () - telemetry_t_enter)
+
+// ----------------
+
+static
+void telemetry_open_socket (const char *path)
+{
+    struct sockaddr_un  addr;
+
+    memset (& addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen (path) >= sizeof (addr.sun_path)) {
+	fprintf (stdout, "ERROR: telemetry_init: socket path '%s' too long\n", path);
+	exit (1);
+    }
+    strcpy (addr.sun_path, path);
+    unlink (path);
+
+    telemetry_listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if ((telemetry_listen_fd < 0)
+	|| (bind (telemetry_listen_fd, (struct sockaddr *) & addr, sizeof (addr)) < 0)
+	|| (listen (telemetry_listen_fd, TELEMETRY_MAX_CLIENTS) < 0)
+	|| (fcntl (telemetry_listen_fd, F_SETFL, O_NONBLOCK) < 0)) {
+	fprintf (stdout, "ERROR: telemetry_init: unable to listen on '%s'\n", path);
+	exit (1);
+    }
+    for (int j = 0; j < TELEMETRY_MAX_CLIENTS; j++)
+	telemetry_client_fds [j] = -1;
+}
+
+// ----------------
+// Write a line to the telemetry file or to each connected socket client
+
+static
+void telemetry_write_line (const char *line, size_t len)
+{
+    if (telemetry_fp != NULL) {
+	fwrite (line, 1, len, telemetry_fp);
+	fflush (telemetry_fp);
+	return;
+    }
+
+    // Accept any new clients
+    while (true) {
+	int fd = accept (telemetry_listen_fd, NULL, NULL);
+	if (fd < 0) break;
+	int j;
+	for (j = 0; j < TELEMETRY_MAX_CLIENTS; j++)
+	    if (telemetry_client_fds [j] < 0) {
+		telemetry_client_fds [j] = fd;
+		break;
+	    }
+	if (j == TELEMETRY_MAX_CLIENTS)
+	    close (fd);
+    }
+
+    // Never block the simulation on a slow client: drop it instead
+    for (int j = 0; j < TELEMETRY_MAX_CLIENTS; j++) {
+	int fd = telemetry_client_fds [j];
+	if (fd < 0) continue;
+	if (send (fd, line, len, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t) len) {
+	    close (fd);
+	    telemetry_client_fds [j] = -1;
+	}
+    }
+}
+
+// ----------------
+// Emit a line for the interval since the previous one
+
+static
+void telemetry_emit (void)
+{
+    telemetry.t_ns = telemetry_now_ns ();
+
+    const Telemetry_Counts *p_prev = ((telemetry_n_intervals == 0)
+				      ? NULL
+				      : & (telemetry_window [(telemetry_n_intervals - 1) % TELEMETRY_WINDOW]));
+    const Telemetry_Counts *p_win  = ((telemetry_n_intervals < TELEMETRY_WINDOW)
+				      ? NULL
+				      : & (telemetry_window [telemetry_n_intervals % TELEMETRY_WINDOW]));
+    Telemetry_Counts  zero;
+    memset (& zero, 0, sizeof (zero));
+    zero.t_ns = telemetry_t0_ns;
+    if (p_prev == NULL) p_prev = & zero;
+    if (p_win  == NULL) p_win  = & zero;
+
+    double dt     = (telemetry.t_ns - p_prev->t_ns) / 1e9;
+    double dt_win = (telemetry.t_ns - p_win->t_ns)  / 1e9;
+    if (dt     <= 0) dt     = 1e-9;
+    if (dt_win <= 0) dt_win = 1e-9;
+
+    char  line [1024];
+    int   n = 0;
+    n += snprintf (line + n, sizeof (line) - n,
+		   "t=%.3f cycles=%" PRIu64 " cps=%.0f cps_win=%.0f bdpi=%.3f",
+		   (telemetry.t_ns - telemetry_t0_ns) / 1e9,
+		   telemetry.cycles,
+		   (telemetry.cycles - p_prev->cycles) / dt,
+		   (telemetry.cycles - p_win->cycles) / dt_win,
+		   ((telemetry.bdpi_ns - p_prev->bdpi_ns) / 1e9) / dt);
+    for (int c = 0; c < TELEMETRY_N_CHANS; c++)
+	if (telemetry.rx_pkts [c] != 0)
+	    n += snprintf (line + n, sizeof (line) - n, " rx%0d=%.0f",
+			   c, (telemetry.rx_pkts [c] - p_prev->rx_pkts [c]) / dt);
+    for (int c = 0; c < TELEMETRY_N_CHANS; c++)
+	if (telemetry.tx_pkts [c] != 0)
+	    n += snprintf (line + n, sizeof (line) - n, " tx%0d=%.0f",
+			   c, (telemetry.tx_pkts [c] - p_prev->tx_pkts [c]) / dt);
+    n += snprintf (line + n, sizeof (line) - n, " ddr_rd=%.0f ddr_wr=%.0f ddr_req=%.0f\n",
+		   (telemetry.ddr_rd_beats - p_prev->ddr_rd_beats) / dt,
+		   (telemetry.ddr_wr_beats - p_prev->ddr_wr_beats) / dt,
+		   (telemetry.ddr_reqs     - p_prev->ddr_reqs)     / dt);
+
+    telemetry_write_line (line, n);
+
+    telemetry_window [telemetry_n_intervals % TELEMETRY_WINDOW] = telemetry;
+    telemetry_n_intervals++;
+}
+
+// ----------------
+// Called every cycle (from c_host_flush)
+
+static inline
+void telemetry_tick (void)
+{
+    telemetry.cycles++;
+    if ((telemetry.cycles & TELEMETRY_POLL_CYCLES_MASK) != 0)
+	return;
+
+    const Telemetry_Counts *p_prev = ((telemetry_n_intervals == 0)
+				      ? NULL
+				      : & (telemetry_window [(telemetry_n_intervals - 1) % TELEMETRY_WINDOW]));
+    uint64_t t_prev = ((p_prev == NULL) ? telemetry_t0_ns : p_prev->t_ns);
+    if ((telemetry_now_ns () - t_prev) >= telemetry_interval_ns)
+	telemetry_emit ();
+}
+
+static inline
+void telemetry_count_pkt (uint64_t *pkts, const uint8_t *bytevec, int chan_byte)
+{
+    uint8_t chan = ((bytevec [0] > chan_byte) ? bytevec [chan_byte] : 0);
+    if (chan >= TELEMETRY_N_CHANS) chan = TELEMETRY_N_CHANS - 1;
+    pkts [chan]++;
+}
+
+static
+void telemetry_at_exit (void)
+{
+    telemetry_emit ();
+    if (telemetry_fp != NULL)
+	fclose (telemetry_fp);
+}
+
+// ----------------
+// Start telemetry if AWSTERIA_TELEMETRY is set (called once connected to the host)
+
+static
+void telemetry_init (void)
+{
+    char *dest = getenv (TELEMETRY_ENV_VAR);
+    if ((dest == NULL) || (dest [0] == 0) || telemetry_on)
+	return;
+
+    char *ms = getenv (TELEMETRY_MS_ENV_VAR);
+    if ((ms != NULL) && (atoi (ms) > 0))
+	telemetry_interval_ns = ((uint64_t) atoi (ms)) * 1000000;
+
+    if (strncmp (dest, TELEMETRY_UNIX_PREFIX, strlen (TELEMETRY_UNIX_PREFIX)) == 0)
+	telemetry_open_socket (dest + strlen (TELEMETRY_UNIX_PREFIX));
+    else if (strcmp (dest, "-") == 0)
+	telemetry_fp = stdout;
+    else {
+	telemetry_fp = fopen (dest, "w");
+	if (telemetry_fp == NULL) {
+	    fprintf (stdout, "ERROR: telemetry_init: unable to open '%s'\n", dest);
+	    exit (1);
+	}
+    }
+    fprintf (stdout, "Telemetry every %0" PRIu64 " ms to %s\n", telemetry_interval_ns / 1000000, dest);
+
+    telemetry_t0_ns = telemetry_now_ns ();
+    telemetry_on    = true;
+    atexit (telemetry_at_exit);
+}
+
+// ****************************************************************
+// ****************************************************************
+// ****************************************************************
+
 // Functions for communication with host-side
 
 // ================================================================
@@ -102,11 +376,342 @@ static uint16_t port = 30000;
 
 static int connected_sockfd = 0;
 
+// Set once c_host_connect has been called (so that a restored
+// checkpoint knows to reconnect)
+static bool host_connected = false;
+
+// Simulated cycles (c_host_flush is called every cycle)
+static uint64_t host_cycles = 0;
+
+// Set by the first call of c_host_flush.  Verilog generated before
+// rl_host_flush was added to Top_HW_Side.bsv never calls it: then
+// c_host_send writes each bytevec through to the host, and cycles are
+// counted by c_host_recv instead (which is called every cycle, unless
+// the comms box is full).
+static bool host_flush_called = false;
+
+// ================================================================
+// Alternatively, shared-memory rings (see SHM_Ring.h), used instead of
+// TCP when env var AWSTERIA_SHM names a segment.
+
+static bool             use_shm         = false;
+static SHM_Segment_Hdr *p_shm_hdr       = NULL;
+static uint64_t         shm_size        = 0;
+static SHM_Ring        *p_ring_to_host   = NULL;    // BSV to C
+static SHM_Ring        *p_ring_from_host = NULL;    // C to BSV
+
+// ================================================================
+// Create shared-memory segment /dev/shm/<shm_name> of 'seg_size' bytes
+// (with rings of 'ring_size' bytes), replacing any stale segment from
+// an earlier run.  Also used for trace output (see c_trace_file_open).
+
+static
+SHM_Segment_Hdr *shm_segment_create (const char *caller, const char *path,
+				     uint64_t seg_size, uint64_t ring_size)
+{
+    unlink (path);
+
+    int fd = open (path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+	fprintf (stderr, "ERROR: %s: open ('%s') failed\n", caller, path);
+	exit (1);
+    }
+
+    if (ftruncate (fd, seg_size) < 0) {
+	fprintf (stderr, "ERROR: %s: ftruncate () failed\n", caller);
+	exit (1);
+    }
+
+    SHM_Segment_Hdr *p_hdr = (SHM_Segment_Hdr *) mmap (NULL, seg_size, PROT_READ | PROT_WRITE,
+							MAP_SHARED, fd, 0);
+    close (fd);
+    if (p_hdr == MAP_FAILED) {
+	fprintf (stderr, "ERROR: %s: mmap () failed\n", caller);
+	exit (1);
+    }
+
+    p_hdr->server_pid       = getpid ();
+    p_hdr->client_connected = 0;
+    p_hdr->server_done      = 0;
+    p_hdr->client_pid       = 0;
+    p_hdr->ring_size        = ring_size;
+    return p_hdr;
+}
+
+// ================================================================
+// Publish a segment whose rings have been initialized, and wait for
+// the client to map it.
+// The file is unlinked once the client has connected, so no stale
+// segment is left behind in /dev/shm.
+
+static
+void shm_segment_await_client (SHM_Segment_Hdr *p_hdr, uint64_t magic, const char *path)
+{
+    __atomic_store_n (& p_hdr->magic, magic, __ATOMIC_RELEASE);
+
+    while (__atomic_load_n (& p_hdr->client_connected, __ATOMIC_ACQUIRE) == 0)
+	usleep (1000);
+
+    unlink (path);
+}
+
+// ================================================================
+// Called in each iteration of a wait on a host ring; every
+// SHM_LIVENESS_CHECK_SPINS iterations, check that the host is still
+// running (otherwise we would wait forever).
+
+static
+void shm_host_check_alive (uint64_t *p_n_spins)
+{
+    *p_n_spins = *p_n_spins + 1;
+    if (((*p_n_spins) % SHM_LIVENESS_CHECK_SPINS) != 0)
+	return;
+    if (! shm_pid_alive (p_shm_hdr->client_pid)) {
+	fprintf (stdout, "ERROR: host-side pid %0" PRId64 " has exited\n", p_shm_hdr->client_pid);
+	exit (1);
+    }
+}
+
+// ================================================================
+// Create the shared-memory segment and wait for the host to map it.
+
+static
+void c_host_connect_shm (const char *shm_name)
+{
+    char path [256];
+    snprintf (path, sizeof (path), "%s%s", SHM_DIR, shm_name);
+
+    fprintf (stdout, "Awaiting remote host connection on shared memory '%s' ...\n", path);
+
+    uint64_t ring_size = SHM_RING_DEFAULT_SIZE;
+    shm_size  = shm_segment_size (ring_size);
+    p_shm_hdr = shm_segment_create ("c_host_connect_shm", path, shm_size, ring_size);
+
+    p_ring_from_host = shm_segment_ring_C_to_BSV (p_shm_hdr);
+    p_ring_to_host   = shm_segment_ring_BSV_to_C (p_shm_hdr);
+    shm_ring_init (p_ring_from_host, ring_size);
+    shm_ring_init (p_ring_to_host,   ring_size);
+
+    shm_segment_await_client (p_shm_hdr, SHM_MAGIC, path);
+
+    fprintf (stdout, "Connected\n");
+    fflush (stdout);
+}
+
+// ================================================================
+// With TCP, a receiver thread reads the socket and publishes complete
+// incoming bytevecs into host_recv_ring, an in-process SPSC ring (see
+// SHM_Ring.h), so that c_host_recv (called every cycle) is just a
+// lock-free ring check with no system call.
+
+#define HOST_RECV_RING_SIZE   (1llu << 20)    // must be a power of 2
+#define HOST_RECV_STAGE_SIZE  0x10000
+
+static SHM_Ring        *host_recv_ring = NULL;
+static pthread_t        host_recv_thread;
+static bool             host_recv_thread_running = false;
+static volatile bool    host_recv_draining       = false;    // discard input (disconnecting)
+
+static
+void host_recv_ring_alloc (void)
+{
+    if (host_recv_ring != NULL)
+	return;
+    host_recv_ring = (SHM_Ring *) malloc (sizeof (SHM_Ring) + HOST_RECV_RING_SIZE);
+    if (host_recv_ring == NULL) {
+	fprintf (stdout, "ERROR: host_recv_ring_alloc: malloc failed\n");
+	exit (1);
+    }
+    shm_ring_init (host_recv_ring, HOST_RECV_RING_SIZE);
+}
+
+static
+void *host_recv_thread_fn (void *arg)
+{
+    static uint8_t  stage [HOST_RECV_STAGE_SIZE];
+    uint32_t        n_staged = 0;
+    int             fd       = connected_sockfd;
+
+    while (true) {
+	ssize_t n = read (fd, & (stage [n_staged]), (HOST_RECV_STAGE_SIZE - n_staged));
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (! host_recv_draining)
+		fprintf (stdout, "ERROR: c_host_recv (): read () failed\n");
+	    break;
+	}
+	if (n == 0) {
+	    if (! host_recv_draining)
+		fprintf (stdout, "c_host_recv: host closed the connection\n");
+	    break;
+	}
+	n_staged += n;
+
+	// Find the complete packets at the front of the staging buffer
+	uint32_t n_complete = 0;
+	while (n_complete < n_staged) {
+	    uint8_t data_size = stage [n_complete];
+	    if (data_size < 2) {
+		fprintf (stdout, "ERROR: c_host_recv (): bad packet size %0d\n", data_size);
+		exit (1);
+	    }
+	    if ((n_staged - n_complete) < data_size)
+		break;
+	    n_complete += data_size;
+	}
+
+	// Publish them, waiting for space if the simulation is behind
+	uint32_t n_put = 0;
+	while ((n_put < n_complete) && (! host_recv_draining)) {
+	    n_put += shm_ring_put (host_recv_ring, & (stage [n_put]), (n_complete - n_put));
+	    if (n_put < n_complete)
+		usleep (100);
+	}
+	memmove (stage, & (stage [n_complete]), (n_staged - n_complete));
+	n_staged -= n_complete;
+    }
+    return NULL;
+}
+
+// ================================================================
+// Outgoing bytevecs are staged in send_buf, and published to
+// host_send_ring when the send stream pauses (see c_host_flush) or the
+// buffer passes a threshold, so a burst of responses (e.g., 64 read
+// data beats) reaches the host as one transfer.
+// With TCP, a writer thread drains host_send_ring, sending everything
+// available with one sendmsg () (two iovecs, in case the data wraps
+// around the ring), so the simulation never waits for the socket.
+
+#define SEND_BUF_SIZE        0x10000
+#define SEND_BUF_THRESHOLD   0x1000
+#define HOST_SEND_RING_SIZE  (1llu << 20)    // must be a power of 2
+
+static uint8_t   send_buf [SEND_BUF_SIZE];
+static uint32_t  send_buf_size    = 0;
+static bool      sent_since_flush = false;
+
+static SHM_Ring        *host_send_ring = NULL;
+static pthread_t        host_send_thread;
+static bool             host_send_thread_running = false;
+static bool             host_send_stop           = false;
+static pthread_mutex_t  host_send_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   host_send_cond  = PTHREAD_COND_INITIALIZER;
+
+static
+void *host_send_thread_fn (void *arg)
+{
+    int       fd   = connected_sockfd;
+    SHM_Ring *p    = host_send_ring;
+    uint64_t  size = p->size;
+
+    while (true) {
+	// Wait for data
+	pthread_mutex_lock (& host_send_mutex);
+	while ((shm_ring_used (p) == 0) && (! host_send_stop))
+	    pthread_cond_wait (& host_send_cond, & host_send_mutex);
+	pthread_mutex_unlock (& host_send_mutex);
+
+	uint64_t used = shm_ring_used (p);
+	if (used == 0)
+	    break;    // stopped, and all sent
+
+	// Send all of it (the data may wrap around the end of the ring)
+	uint64_t      head  = __atomic_load_n (& p->head, __ATOMIC_RELAXED);
+	uint64_t      index = (head & (size - 1));
+	uint64_t      n1    = ((used < (size - index)) ? used : (size - index));
+	struct iovec  iov [2];
+	struct msghdr msg;
+	iov [0].iov_base = shm_ring_data (p) + index;
+	iov [0].iov_len  = n1;
+	iov [1].iov_base = shm_ring_data (p);
+	iov [1].iov_len  = used - n1;
+	memset (& msg, 0, sizeof (msg));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = ((used == n1) ? 1 : 2);
+
+	ssize_t n = sendmsg (fd, & msg, MSG_NOSIGNAL);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    fprintf (stdout, "ERROR: c_host_send (): sendmsg () failed\n");
+	    exit (1);
+	}
+	__atomic_store_n (& p->head, head + n, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static
+void host_send_thread_start (void)
+{
+    if (host_send_ring == NULL) {
+	host_send_ring = (SHM_Ring *) malloc (sizeof (SHM_Ring) + HOST_SEND_RING_SIZE);
+	if (host_send_ring == NULL) {
+	    fprintf (stdout, "ERROR: host_send_thread_start: malloc failed\n");
+	    exit (1);
+	}
+	shm_ring_init (host_send_ring, HOST_SEND_RING_SIZE);
+    }
+    host_send_stop = false;
+    if (pthread_create (& host_send_thread, NULL, host_send_thread_fn, NULL) != 0) {
+	fprintf (stderr, "ERROR: c_host_connect: pthread_create () failed\n");
+	exit (1);
+    }
+    host_send_thread_running = true;
+}
+
+// ----------------
+// Publish send_buf to the writer thread.
+// Only waits if the ring is full (the host is not keeping up).
+
+static
+void host_send_buf_write (void)
+{
+    uint32_t  n_put = 0;
+
+    while (true) {
+	n_put += shm_ring_put (host_send_ring, & (send_buf [n_put]), (send_buf_size - n_put));
+
+	pthread_mutex_lock (& host_send_mutex);
+	pthread_cond_signal (& host_send_cond);
+	pthread_mutex_unlock (& host_send_mutex);
+
+	if (n_put == send_buf_size)
+	    break;
+	sched_yield ();
+    }
+    send_buf_size = 0;
+}
+
+// ----------------
+// Publish send_buf and wait until the writer thread has sent everything
+
+static
+void host_send_drain (void)
+{
+    if (send_buf_size != 0)
+	host_send_buf_write ();
+    while ((host_send_ring != NULL) && (shm_ring_used (host_send_ring) != 0))
+	sched_yield ();
+}
+
 // ================================================================
 // Connect to remote host on tcp_port (host is client, we are server)
 
 void  c_host_connect (const uint16_t tcp_port)
 {
+    port           = tcp_port;
+    host_connected = true;
+
+    char *shm_name = getenv (SHM_ENV_VAR);
+    if (shm_name != NULL) {
+	use_shm = true;
+	c_host_connect_shm (shm_name);
+	telemetry_init ();
+	return;
+    }
+
     int                 listen_sockfd;        // listening socket
     struct sockaddr_in  servaddr;             // socket address structure
     struct linger       linger;
@@ -174,8 +779,26 @@ void  c_host_connect (const uint16_t tcp_port)
 	exit (1);
     }
 
+    // The receiver thread does blocking reads
+    flags = fcntl (connected_sockfd, F_GETFL, 0);
+    if ((flags < 0) || (fcntl (connected_sockfd, F_SETFL, (flags & (~ O_NONBLOCK))) < 0)) {
+	fprintf (stderr, "ERROR: c_host_connect: fcntl (connected_sockfd) failed\n");
+	exit (1);
+    }
+    host_recv_ring_alloc ();
+    host_recv_draining = false;
+    if (pthread_create (& host_recv_thread, NULL, host_recv_thread_fn, NULL) != 0) {
+	fprintf (stderr, "ERROR: c_host_connect: pthread_create () failed\n");
+	exit (1);
+    }
+    host_recv_thread_running = true;
+
+    host_send_thread_start ();
+
     fprintf (stdout, "Connected\n");
     fflush (stdout);
+
+    telemetry_init ();
 }
 
 // ================================================================
@@ -184,20 +807,34 @@ void  c_host_connect (const uint16_t tcp_port)
 
 void c_host_disconnect (uint8_t dummy)
 {
-    uint8_t buf [128];
-    ssize_t n;
+    if (use_shm) {
+	fprintf (stdout, "c_host_disconnect: from host on shared memory\n");
+	munmap (p_shm_hdr, shm_size);
+	p_shm_hdr = NULL;
+	return;
+    }
 
     fprintf (stdout, "c_host_disconnect: from host on port %0d\n", port);
 
+    // Send everything still staged, then stop the writer thread
+    if (host_send_thread_running) {
+	host_send_drain ();
+	pthread_mutex_lock (& host_send_mutex);
+	host_send_stop = true;
+	pthread_cond_signal (& host_send_cond);
+	pthread_mutex_unlock (& host_send_mutex);
+	pthread_join (host_send_thread, NULL);
+	host_send_thread_running = false;
+    }
+
     shutdown (connected_sockfd, SHUT_WR);
 
-    // Drain remaining bytes arriving
-    while (1) {
-	n = recv (connected_sockfd, buf, 128, 0);
-	if (n == 0)
-	    break;
-	if ((n == -1) && (errno != EINTR))
-	    break;
+    // Drain remaining bytes arriving (the receiver thread discards them
+    // and finishes when the host closes its end)
+    if (host_recv_thread_running) {
+	host_recv_draining = true;
+	pthread_join (host_recv_thread, NULL);
+	host_recv_thread_running = false;
     }
 
     if (close (connected_sockfd) < 0) {
@@ -216,89 +853,121 @@ void c_host_disconnect (uint8_t dummy)
 // An actual packet has at least 2 bytes (size, type).
 // An actual packet must be smaller than 'size_bytes'.
 // We return with [0] = 0 if no data is availble
+// Incoming bytevecs are taken from the SHM ring, or with TCP from
+// host_recv_ring, which the receiver thread fills.  After a restore,
+// bytevecs saved in the checkpoint are in host_recv_ring, and with SHM
+// too they are taken first.
 
-void c_host_recv (uint8_t *bytevec, uint8_t bytevec_size)
-{
-    // ----------------
-    // First, poll to check if any data is available
-    int fd = connected_sockfd;
-
-    struct pollfd  x_pollfd;
-    x_pollfd.fd      = fd;
-    x_pollfd.events  = POLLRDNORM;
-    x_pollfd.revents = 0;
+// ----------------
+// Count a simulated cycle
 
-    int n = poll (& x_pollfd, 1, 0);
+static inline
+void host_cycle_tick (void)
+{
+    host_cycles++;
+    if (telemetry_on)
+	telemetry_tick ();
+}
 
-    if (n < 0) {
-	fprintf (stdout, "ERROR: c_host_recv (): poll () failed\n");
-	exit (1);
-    }
+static
+void host_recv (uint8_t *bytevec, uint8_t bytevec_size)
+{
+    SHM_Ring *p_ring = host_recv_ring;
+    if (use_shm && ((p_ring == NULL) || (shm_ring_used (p_ring) == 0)))
+	p_ring = p_ring_from_host;
 
-    if ((x_pollfd.revents & POLLRDNORM) == 0) {
+    uint64_t used = shm_ring_used (p_ring);
+    if (used == 0) {
 	// No byte available; return '0' in the bytevec [0]
 	bytevec [0] = 0;
 	return;
     }
-
-    // ----------------
-    // Data is available; read the first byte, which specifies # of bytes in the 'packet'
-
-    int  data_size = 1;
-    int  n_recd    = 0;
-    while (n_recd < data_size) {
-	int n = read (fd, & bytevec [n_recd], (data_size - n_recd));
-	if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
-	    fprintf (stdout, "ERROR: c_host_recv (): read () failed on byte 0\n");
-	    exit (1);
-	}
-	else if (n > 0) {
-	    n_recd += n;
-	}
-    }
-
-    // ----------------
-    // Read the remaining bytes
-
-    data_size = bytevec [0];
+    uint8_t data_size = shm_ring_peek (p_ring, 0);
     assert (data_size >= 2);
     assert (data_size <= bytevec_size);
-    n_recd    = 1;
-    while (n_recd < data_size) {
-	int n = read (fd, & bytevec [n_recd], (data_size - n_recd));
-	if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
-	    fprintf (stdout, "ERROR: c_host_recv (): read () failed after %0d bytes\n", n_recd);
-	    exit (1);
-	}
-	else if (n > 0) {
-	    n_recd += n;
-	}
+
+    // With SHM the host may still be writing the packet: wait for all of it.
+    // (The receiver thread only publishes complete packets.)
+    uint64_t n_spins = 0;
+    while (used < data_size) {
+	shm_host_check_alive (& n_spins);
+	sched_yield ();
+	used = shm_ring_used (p_ring);
     }
+    shm_ring_get (p_ring, bytevec, data_size);
+}
+
+void c_host_recv (uint8_t *bytevec, uint8_t bytevec_size)
+{
+    TELEMETRY_BDPI_ENTER;
+    host_recv (bytevec, bytevec_size);
+    if (telemetry_on && (bytevec [0] != 0))
+	telemetry_count_pkt (telemetry.rx_pkts, bytevec, TELEMETRY_C_TO_BSV_CHAN_BYTE);
+    TELEMETRY_BDPI_EXIT;
+
+    if (! host_flush_called)
+	host_cycle_tick ();
 }
 
 // ================================================================
 // Send a bytevec to remote host
 // bytevec [0] specifies # of bytes to send
 
-void c_host_send (const uint8_t *bytevec, uint8_t bytevec_size)
+static
+void host_send (const uint8_t *bytevec, uint8_t bytevec_size)
 {
-    int  fd = connected_sockfd;
     int  data_size;
     int  n_sent;
 
     data_size = bytevec [0];
     n_sent    = 0;
-    while (n_sent < data_size) {
-	int n = write (fd, & (bytevec [n_sent]), (data_size - n_sent));
-	if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
-	    fprintf (stdout, "ERROR: c_host_send (): write () failed after %0d bytes\n", n_sent);
-	    exit (1);
-	}
-	else if (n > 0) {
-	    n_sent += n;
+
+    if (use_shm) {
+	uint64_t n_spins = 0;
+	while (n_sent < data_size) {
+	    n_sent += shm_ring_put (p_ring_to_host, & (bytevec [n_sent]), (data_size - n_sent));
+	    if (n_sent < data_size) {
+		shm_host_check_alive (& n_spins);
+		sched_yield ();
+	    }
 	}
+	return;
     }
-    fsync (fd);
+
+    if ((send_buf_size + data_size) > SEND_BUF_SIZE)
+	host_send_buf_write ();
+
+    memcpy (& (send_buf [send_buf_size]), bytevec, data_size);
+    send_buf_size   += data_size;
+    sent_since_flush = true;
+
+    if ((send_buf_size >= SEND_BUF_THRESHOLD) || (! host_flush_called))
+	host_send_buf_write ();
+}
+
+void c_host_send (const uint8_t *bytevec, uint8_t bytevec_size)
+{
+    TELEMETRY_BDPI_ENTER;
+    if (telemetry_on)
+	telemetry_count_pkt (telemetry.tx_pkts, bytevec, TELEMETRY_BSV_TO_C_CHAN_BYTE);
+    host_send (bytevec, bytevec_size);
+    TELEMETRY_BDPI_EXIT;
+}
+
+// ================================================================
+// Called every cycle: write out staged bytevecs to remote host if
+// nothing was sent since the previous call (the send stream paused).
+
+void c_host_flush (uint8_t dummy)
+{
+    TELEMETRY_BDPI_ENTER;
+    host_flush_called = true;
+    if ((send_buf_size != 0) && (! sent_since_flush))
+	host_send_buf_write ();
+    sent_since_flush = false;
+    TELEMETRY_BDPI_EXIT;
+
+    host_cycle_tick ();
 }
 
 // ================================================================
@@ -351,54 +1020,491 @@ int main (int argc, char *argv [])
 
 // Functions for Tandem Verification trace file output.
 
-static char trace_file_name[] = "trace_data.dat";
-
-static FILE *trace_file_stream;
-
-static uint64_t trace_file_size   = 0;
-static uint64_t trace_file_writes = 0;
+// Trace records are appended to a page in memory, and full pages are
+// written to the file by a writer thread.  There are two pages (double
+// buffering): the simulation fills one while the other is written, and
+// only waits if the writer falls a whole page behind.
+// A record is loaded into 'buf' a byte or a word64 at a time and then
+// appended with c_trace_file_write_buffer ().
+
+// If env var AWSTERIA_TRACE_COMPRESS is set to a zlib level 1..9 (any
+// other non-empty value means level 6), the trace is written
+// gzip-compressed to trace_out.dat.gz (read it with zcat, or gzopen ()).
+
+// If env var AWSTERIA_TRACE_SEGMENT is set to K, the trace file is
+// divided into segments of K records, and each segment is described by
+// an entry in index file trace_out.idx, written as each segment is
+// finished (so a run that is cut short still leaves usable segments):
+//     Trace_Index_Hdr
+//     Trace_Index_Entry [n_segments]
+// A record is numbered in order of writing from 0; with the usual
+// one record per retired instruction this is the instruction count.
+// A compressed segment is one gzip member (or more, if a checkpoint was
+// taken within it), so it can be decompressed on its own, starting at
+// its file_offset.  The file as a whole is still a valid gzip file.
+
+// If env var AWSTERIA_TRACE_SHM names a shared-memory segment, no file
+// is written: records are published directly into a ring in segment
+// /dev/shm/<name> (see SHM_Ring.h) for a concurrently running checker
+// (see src_Host_Side/SHM_Trace_Reader.h).  c_trace_file_open () waits
+// for the checker to connect, and the simulation stalls while the ring
+// is full (if the checker exits meanwhile, tracing stops with an
+// error).  The ring size in bytes is AWSTERIA_TRACE_SHM_SIZE (rounded up
+// to a power of 2; default 16 MB).
+
+#define TRACE_COMPRESS_ENV_VAR   "AWSTERIA_TRACE_COMPRESS"
+#define TRACE_SEGMENT_ENV_VAR    "AWSTERIA_TRACE_SEGMENT"
+
+#define TRACE_PAGE_SIZE          (1 << 20)
+#define TRACE_N_PAGES            2
+
+static char trace_file_name [32] = "trace_out.dat";
+
+static FILE   *trace_file_stream    = NULL;
+static gzFile  trace_file_gz        = NULL;
+static int     trace_compress_level = 0;    // 0: uncompressed
+
+static SHM_Segment_Hdr *trace_shm_hdr  = NULL;
+static uint64_t         trace_shm_size = 0;
+static SHM_Ring        *trace_shm_ring = NULL;
+
+static uint64_t trace_file_size   = 0;      // bytes of trace data (uncompressed)
+static uint64_t trace_file_writes = 0;      // # of records
+
+#define TRACE_INDEX_MAGIC    "AWSTRIDX"
+#define TRACE_INDEX_VERSION  1
+
+typedef struct {
+    char      magic [8];
+    uint32_t  version;
+    uint32_t  compress_level;     // 0: uncompressed
+    uint64_t  segment_records;    // K
+} Trace_Index_Hdr;
+
+typedef struct {
+    uint64_t  first_record;       // number of the first record in the segment
+    uint64_t  n_records;
+    uint64_t  first_cycle;        // cycles at which the first and last records
+    uint64_t  last_cycle;         // were written
+    uint64_t  data_offset;        // segment position in the uncompressed trace
+    uint64_t  data_bytes;
+    uint64_t  file_offset;        // segment position in the trace file
+    uint64_t  file_bytes;
+} Trace_Index_Entry;
+
+static char               trace_index_name [] = "trace_out.idx";
+static FILE              *trace_index_stream        = NULL;
+static uint64_t           trace_segment_records     = 0;    // 0: no segments
+static Trace_Index_Entry  trace_segment;                    // being filled
+static uint64_t           trace_segment_file_offset = 0;    // writer thread
+
+typedef struct {
+    uint8_t            *data;
+    uint32_t            n_bytes;
+    bool                full;           // handed to the writer thread
+    bool                end_segment;    // last page of 'segment'
+    Trace_Index_Entry   segment;
+} Trace_Page;
+
+static Trace_Page       trace_pages [TRACE_N_PAGES];
+static int              trace_page_fill    = 0;    // page being filled
+static bool             trace_write_failed = false;    // set by the writer thread (atomic)
+static pthread_t        trace_thread;
+static bool             trace_thread_stop  = false;
+static pthread_mutex_t  trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   trace_cond  = PTHREAD_COND_INITIALIZER;
 
 #define BUFSIZE 1024
 static uint8_t buf [BUFSIZE];
 
-// ================================================================
-// c_trace_file_open()
-// Open file for recording binary trace output.
+// ----------------
+// Finish a segment in the trace file (all its data has been written),
+// and append its index entry.  Called in the writer thread.
 
-uint32_t c_trace_file_open (uint8_t dummy)
+static
+bool trace_index_write (Trace_Index_Entry *p_entry)
 {
-    uint32_t success = 0;
-
-    trace_file_stream = fopen ("trace_out.dat", "w");
-    if (trace_file_stream == NULL) {
-	fprintf (stderr, "ERROR: c_trace_file_open: unable to open file '%s'.\n", trace_file_name);
-	success = 0;
+    int64_t file_end;
+    if (trace_file_gz != NULL) {
+	if (gzflush (trace_file_gz, Z_FINISH) != Z_OK)
+	    return false;
+	file_end = gzoffset (trace_file_gz);
     }
     else {
-	fprintf (stdout, "c_trace_file_stream: opened file '%s' for trace_data.\n", trace_file_name);
-	success = 1;
+	if (fflush (trace_file_stream) != 0)
+	    return false;
+	file_end = ftello (trace_file_stream);
     }
-    return success;
+    if (file_end < 0)
+	return false;
+
+    p_entry->file_offset      = trace_segment_file_offset;
+    p_entry->file_bytes       = file_end - trace_segment_file_offset;
+    trace_segment_file_offset = file_end;
+
+    return ((fwrite (p_entry, sizeof (Trace_Index_Entry), 1, trace_index_stream) == 1)
+	    && (fflush (trace_index_stream) == 0));
 }
 
-// ================================================================
-// c_trace_file_load_byte_in_buffer ()
-// Write 8-bit 'data' into output buffer at byte offset 'j'
+// ----------------
+// Writer thread: write out full pages, in fill order.
+// After a write error, data is dropped and c_trace_file_write_* fail.
 
-uint32_t c_trace_file_load_byte_in_buffer (uint32_t j, uint8_t data)
+static
+void *trace_thread_fn (void *arg)
 {
-    uint32_t success = 0;
+    int j = 0;
 
-    if (j >= BUFSIZE) {
-	fprintf (stderr, "ERROR: c_trace_file_load_byte_in_buffer: index (%0d) out of bounds (%0d)\n",
-		 j, BUFSIZE);
-	success = 0;
-    }
-    else {
-	buf [j] = data;
-	success = 1;
+    while (true) {
+	pthread_mutex_lock (& trace_mutex);
+	while ((! trace_pages [j].full) && (! trace_thread_stop))
+	    pthread_cond_wait (& trace_cond, & trace_mutex);
+	bool full = trace_pages [j].full;
+	pthread_mutex_unlock (& trace_mutex);
+	if (! full)
+	    break;    // stopped, and all written
+
+	uint32_t n  = trace_pages [j].n_bytes;
+	bool     ok;
+	if (trace_file_gz != NULL)
+	    ok = (gzwrite (trace_file_gz, trace_pages [j].data, n) == (int) n);
+	else
+	    ok = (fwrite (trace_pages [j].data, 1, n, trace_file_stream) == n);
+	if (ok && trace_pages [j].end_segment)
+	    ok = trace_index_write (& (trace_pages [j].segment));
+	if ((! ok) && (! __atomic_load_n (& trace_write_failed, __ATOMIC_ACQUIRE))) {
+	    fprintf (stderr, "ERROR: c_trace_file_write: write to '%s' failed\n", trace_file_name);
+	    __atomic_store_n (& trace_write_failed, true, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_lock (& trace_mutex);
+	trace_pages [j].n_bytes     = 0;
+	trace_pages [j].full        = false;
+	trace_pages [j].end_segment = false;
+	pthread_cond_broadcast (& trace_cond);
+	pthread_mutex_unlock (& trace_mutex);
+	j = (j + 1) % TRACE_N_PAGES;
     }
-    return success;
+    return NULL;
+}
+
+// ----------------
+// Hand the page being filled to the writer thread, and move on to the
+// next one (waiting until the writer is done with it).
+
+static
+void trace_page_submit (void)
+{
+    pthread_mutex_lock (& trace_mutex);
+    trace_pages [trace_page_fill].full = true;
+    pthread_cond_broadcast (& trace_cond);
+    trace_page_fill = (trace_page_fill + 1) % TRACE_N_PAGES;
+    while (trace_pages [trace_page_fill].full)
+	pthread_cond_wait (& trace_cond, & trace_mutex);
+    pthread_mutex_unlock (& trace_mutex);
+}
+
+// ----------------
+// End the segment being filled: it goes to the writer thread with the
+// page being filled.
+
+static
+void trace_segment_end (void)
+{
+    Trace_Page *p = & (trace_pages [trace_page_fill]);
+
+    trace_segment.n_records  = trace_file_writes - trace_segment.first_record;
+    trace_segment.data_bytes = trace_file_size   - trace_segment.data_offset;
+    p->segment     = trace_segment;
+    p->end_segment = true;
+    trace_page_submit ();
+
+    trace_segment.first_record = trace_file_writes;
+    trace_segment.data_offset  = trace_file_size;
+}
+
+// ----------------
+// Append a record to the trace
+
+static
+uint32_t trace_append (const uint8_t *data, uint32_t n)
+{
+    if (trace_shm_ring != NULL) {
+	// Wait until the checker has made room for the whole record;
+	// if the checker has exited, stop tracing (later writes fail).
+	uint64_t n_spins = 0;
+	while (shm_ring_free (trace_shm_ring) < n) {
+	    n_spins++;
+	    if (((n_spins % SHM_LIVENESS_CHECK_SPINS) == 0)
+		&& (! shm_pid_alive (trace_shm_hdr->client_pid))) {
+		fprintf (stderr, "ERROR: c_trace_file_write: trace checker pid %0" PRId64
+			 " has exited; tracing disabled\n", trace_shm_hdr->client_pid);
+		munmap (trace_shm_hdr, trace_shm_size);
+		trace_shm_hdr  = NULL;
+		trace_shm_ring = NULL;
+		return 0;
+	    }
+	    sched_yield ();
+	}
+	shm_ring_put (trace_shm_ring, data, n);
+	trace_file_size   += n;
+	trace_file_writes += 1;
+	return 1;
+    }
+
+    if ((trace_pages [0].data == NULL) || __atomic_load_n (& trace_write_failed, __ATOMIC_ACQUIRE))
+	return 0;
+
+    if (trace_segment_records != 0) {
+	if (trace_file_writes == trace_segment.first_record)
+	    trace_segment.first_cycle = host_cycles;
+	trace_segment.last_cycle = host_cycles;
+    }
+
+    if ((trace_pages [trace_page_fill].n_bytes + n) > TRACE_PAGE_SIZE)
+	trace_page_submit ();
+
+    Trace_Page *p = & (trace_pages [trace_page_fill]);
+    memcpy (p->data + p->n_bytes, data, n);
+    p->n_bytes        += n;
+    trace_file_size   += n;
+    trace_file_writes += 1;
+
+    // End the segment as soon as it is complete, so that it is indexed
+    // even if the run stops right after its last record
+    if ((trace_segment_records != 0)
+	&& ((trace_file_writes - trace_segment.first_record) == trace_segment_records))
+	trace_segment_end ();
+    return 1;
+}
+
+// ----------------
+// Wait until the writer thread has written everything appended so far
+
+static
+void trace_flush (void)
+{
+    if (trace_pages [trace_page_fill].n_bytes != 0)
+	trace_page_submit ();
+
+    pthread_mutex_lock (& trace_mutex);
+    for (int j = 0; j < TRACE_N_PAGES; j++)
+	while (trace_pages [j].full)
+	    pthread_cond_wait (& trace_cond, & trace_mutex);
+    pthread_mutex_unlock (& trace_mutex);
+}
+
+static
+void trace_file_atexit (void)
+{
+    c_trace_file_close (0);
+}
+
+// ----------------
+// Create the trace segment and wait for the checker to connect
+
+static
+void trace_shm_open (const char *shm_name)
+{
+    char path [256];
+    snprintf (path, sizeof (path), "%s%s", SHM_DIR, shm_name);
+    snprintf (trace_file_name, sizeof (trace_file_name), "%s", shm_name);
+
+    uint64_t ring_size = SHM_TRACE_DEFAULT_SIZE;
+    char *size_str = getenv (TRACE_SHM_SIZE_ENV_VAR);
+    if ((size_str != NULL) && (size_str [0] != 0)) {
+	uint64_t size = strtoull (size_str, NULL, 0);
+	for (ring_size = 0x10000; ring_size < size; ring_size = ring_size << 1)
+	    ;
+    }
+
+    fprintf (stdout, "Awaiting trace checker connection on shared memory '%s' (ring %0" PRId64 " bytes) ...\n",
+	     path, ring_size);
+
+    trace_shm_size = shm_trace_segment_size (ring_size);
+    trace_shm_hdr  = shm_segment_create ("c_trace_file_open", path, trace_shm_size, ring_size);
+    trace_shm_ring = shm_trace_segment_ring (trace_shm_hdr);
+    shm_ring_init (trace_shm_ring, ring_size);
+
+    shm_segment_await_client (trace_shm_hdr, SHM_TRACE_MAGIC, path);
+
+    fprintf (stdout, "Trace checker connected\n");
+    fflush (stdout);
+}
+
+// ----------------
+// Open the trace index file, if the trace is segmented.
+// On checkpoint restore ('restore_offset' >= 0) the existing file is
+// truncated to restore_offset and appended to.
+// Returns true if ok.
+
+static
+bool trace_index_open (int64_t restore_offset)
+{
+    if (trace_segment_records == 0)
+	return true;
+
+    if (restore_offset < 0) {
+	Trace_Index_Hdr  hdr;
+	memset (& hdr, 0, sizeof (hdr));
+	memcpy (hdr.magic, TRACE_INDEX_MAGIC, sizeof (hdr.magic));
+	hdr.version         = TRACE_INDEX_VERSION;
+	hdr.compress_level  = trace_compress_level;
+	hdr.segment_records = trace_segment_records;
+
+	trace_index_stream = fopen (trace_index_name, "w");
+	if ((trace_index_stream == NULL)
+	    || (fwrite (& hdr, sizeof (hdr), 1, trace_index_stream) != 1))
+	    return false;
+
+	memset (& trace_segment, 0, sizeof (trace_segment));
+	trace_segment.first_record = trace_file_writes;
+	trace_segment.data_offset  = trace_file_size;
+	trace_segment_file_offset  = 0;
+    }
+    else {
+	trace_index_stream = fopen (trace_index_name, "r+");
+	if ((trace_index_stream == NULL)
+	    || (ftruncate (fileno (trace_index_stream), restore_offset) < 0)
+	    || (fseek (trace_index_stream, restore_offset, SEEK_SET) < 0))
+	    return false;
+    }
+    return true;
+}
+
+// ----------------
+// Open the trace file (and index) and start the writer thread.
+// On checkpoint restore (offsets >= 0) the existing files are
+// truncated to the given offsets and appended to.
+// Returns true if ok.
+
+static
+bool trace_file_open_stream (int64_t restore_offset, int64_t restore_index_offset)
+{
+    if (trace_compress_level != 0) {
+	char mode [8];
+	snprintf (trace_file_name, sizeof (trace_file_name), "trace_out.dat.gz");
+	snprintf (mode, sizeof (mode), "%cb%d", ((restore_offset < 0) ? 'w' : 'a'), trace_compress_level);
+	if ((restore_offset >= 0) && (truncate (trace_file_name, restore_offset) < 0))
+	    return false;
+	trace_file_gz = gzopen (trace_file_name, mode);
+	if (trace_file_gz == NULL)
+	    return false;
+	gzbuffer (trace_file_gz, TRACE_PAGE_SIZE);
+    }
+    else if (restore_offset < 0) {
+	trace_file_stream = fopen (trace_file_name, "w");
+	if (trace_file_stream == NULL)
+	    return false;
+    }
+    else {
+	trace_file_stream = fopen (trace_file_name, "r+");
+	if ((trace_file_stream == NULL)
+	    || (ftruncate (fileno (trace_file_stream), restore_offset) < 0)
+	    || (fseek (trace_file_stream, restore_offset, SEEK_SET) < 0))
+	    return false;
+    }
+
+    if (! trace_index_open (restore_index_offset))
+	return false;
+
+    for (int j = 0; j < TRACE_N_PAGES; j++) {
+	if (trace_pages [j].data == NULL) {
+	    trace_pages [j].data = (uint8_t *) malloc (TRACE_PAGE_SIZE);
+	    if (trace_pages [j].data == NULL) {
+		fprintf (stdout, "ERROR: c_trace_file_open: malloc failed\n");
+		exit (1);
+	    }
+	}
+	trace_pages [j].n_bytes     = 0;
+	trace_pages [j].full        = false;
+	trace_pages [j].end_segment = false;
+    }
+    trace_page_fill    = 0;
+    __atomic_store_n (& trace_write_failed, false, __ATOMIC_RELEASE);
+    trace_thread_stop  = false;
+    if (pthread_create (& trace_thread, NULL, trace_thread_fn, NULL) != 0) {
+	fprintf (stderr, "ERROR: c_trace_file_open: pthread_create () failed\n");
+	exit (1);
+    }
+    return true;
+}
+
+// ----------------
+// Start trace output, to the trace segment or the trace file.
+// Returns true if ok.
+
+static
+bool trace_file_start (int64_t restore_offset, int64_t restore_index_offset)
+{
+    char *shm_name = getenv (TRACE_SHM_ENV_VAR);
+    if ((shm_name != NULL) && (shm_name [0] != 0)) {
+	trace_shm_open (shm_name);
+	trace_compress_level  = 0;
+	trace_segment_records = 0;
+    }
+    else if (! trace_file_open_stream (restore_offset, restore_index_offset))
+	return false;
+
+    // Close the trace even if it is not explicitly closed, so that pages
+    // still in memory are written out (or the checker sees the end)
+    static bool atexit_registered = false;
+    if (! atexit_registered) {
+	atexit (trace_file_atexit);
+	atexit_registered = true;
+    }
+    return true;
+}
+
+// ================================================================
+// c_trace_file_open()
+// Open file for recording binary trace output.
+
+uint32_t c_trace_file_open (uint8_t dummy)
+{
+    uint32_t success = 0;
+
+    char *level = getenv (TRACE_COMPRESS_ENV_VAR);
+    if ((level != NULL) && (level [0] != 0)) {
+	trace_compress_level = atoi (level);
+	if ((trace_compress_level < 1) || (trace_compress_level > 9))
+	    trace_compress_level = 6;
+    }
+
+    char *segment = getenv (TRACE_SEGMENT_ENV_VAR);
+    if ((segment != NULL) && (segment [0] != 0))
+	trace_segment_records = strtoull (segment, NULL, 0);
+
+    if (! trace_file_start (-1, -1)) {
+	fprintf (stderr, "ERROR: c_trace_file_open: unable to open file '%s'.\n", trace_file_name);
+	success = 0;
+    }
+    else {
+	fprintf (stdout, "c_trace_file_stream: opened %s '%s' for trace_data.\n",
+		 ((trace_shm_hdr != NULL) ? "shared memory" : "file"), trace_file_name);
+	success = 1;
+    }
+    return success;
+}
+
+// ================================================================
+// c_trace_file_load_byte_in_buffer ()
+// Write 8-bit 'data' into output buffer at byte offset 'j'
+
+uint32_t c_trace_file_load_byte_in_buffer (uint32_t j, uint8_t data)
+{
+    uint32_t success = 0;
+
+    if (j >= BUFSIZE) {
+	fprintf (stderr, "ERROR: c_trace_file_load_byte_in_buffer: index (%0d) out of bounds (%0d)\n",
+		 j, BUFSIZE);
+	success = 0;
+    }
+    else {
+	buf [j] = data;
+	success = 1;
+    }
+    return success;
 }
 
 // ================================================================
@@ -429,15 +1535,17 @@ uint32_t c_trace_file_load_word64_in_buffer (uint32_t byte_offset, uint64_t data
 uint32_t c_trace_file_write_buffer (uint32_t n)
 {
     uint32_t success = 0;
+    TELEMETRY_BDPI_ENTER;
 
-    size_t n_written = fwrite (buf, 1, n, trace_file_stream);
-    if (n_written != n)
+    if (n > BUFSIZE) {
+	fprintf (stderr, "ERROR: c_trace_file_write_buffer: size (%0d) out of bounds (%0d)\n",
+		 n, BUFSIZE);
 	success = 0;
-    else {
-	trace_file_size   += n;
-	trace_file_writes += 1;
-	success = 1;
     }
+    else
+	success = trace_append (buf, n);
+
+    TELEMETRY_BDPI_EXIT;
     return success;
 }
 
@@ -450,18 +1558,56 @@ uint32_t c_trace_file_close (uint8_t dummy)
     uint32_t success = 0;
     int      status;
 
-    if (trace_file_stream == NULL)
+    if (trace_shm_hdr != NULL) {
+	// The checker keeps its own mapping, and reads what is left
+	__atomic_store_n (& trace_shm_hdr->server_done, 1, __ATOMIC_RELEASE);
+	munmap (trace_shm_hdr, trace_shm_size);
+	trace_shm_hdr  = NULL;
+	trace_shm_ring = NULL;
+	fprintf (stdout, "c_trace_file_stream: closed shared memory '%s' for trace_data.\n", trace_file_name);
+	fprintf (stdout, "    Trace file writes: %0" PRId64 "\n", trace_file_writes);
+	fprintf (stdout, "    Trace file size:   %0" PRId64 " bytes\n", trace_file_size);
+	success = 1;
+    }
+    else if ((trace_file_stream == NULL) && (trace_file_gz == NULL))
 	success = 1;
     else {
-	status = fclose (trace_file_stream);
-	if (status != 0) {
-	    fprintf (stderr, "ERROR: c_trace_file_close: error in fclose()\n");
+	// Write out remaining pages and stop the writer thread
+	if ((trace_segment_records != 0) && (trace_file_writes != trace_segment.first_record))
+	    trace_segment_end ();
+	trace_flush ();
+	pthread_mutex_lock (& trace_mutex);
+	trace_thread_stop = true;
+	pthread_cond_broadcast (& trace_cond);
+	pthread_mutex_unlock (& trace_mutex);
+	pthread_join (trace_thread, NULL);
+
+	if (trace_file_gz != NULL) {
+	    status = gzclose (trace_file_gz);
+	    trace_file_gz = NULL;
+	}
+	else {
+	    status = fclose (trace_file_stream);
+	    trace_file_stream = NULL;
+	}
+	if ((trace_index_stream != NULL) && (fclose (trace_index_stream) != 0))
+	    status = EOF;
+	trace_index_stream = NULL;
+	if ((status != 0) || __atomic_load_n (& trace_write_failed, __ATOMIC_ACQUIRE)) {
+	    fprintf (stderr, "ERROR: c_trace_file_close: error in writing or closing '%s'\n",
+		     trace_file_name);
 	    success = 0;
 	}
 	else {
 	    fprintf (stdout, "c_trace_file_stream: closed file '%s' for trace_data.\n", trace_file_name);
 	    fprintf (stdout, "    Trace file writes: %0" PRId64 "\n", trace_file_writes);
 	    fprintf (stdout, "    Trace file size:   %0" PRId64 " bytes\n", trace_file_size);
+	    struct stat st;
+	    if ((trace_compress_level != 0) && (stat (trace_file_name, & st) == 0))
+		fprintf (stdout, "    Compressed size:   %0" PRId64 " bytes\n", (int64_t) st.st_size);
+	    if (trace_segment_records != 0)
+		fprintf (stdout, "    Trace index:       '%s', segments of %0" PRId64 " records\n",
+			 trace_index_name, trace_segment_records);
 	    success = 1;
 	}
     }
@@ -471,3 +1617,904 @@ uint32_t c_trace_file_close (uint8_t dummy)
 // ****************************************************************
 // ****************************************************************
 // ****************************************************************
+
+// Functions for the AWS DDR4 memory model (AWS_DDR4_Model.bsv).
+
+// Storage is sparse: each DDR4's 16 GB is covered by a two-level page
+// table of 4 KB pages, allocated (zeroed) on first write.  Reads of
+// untouched pages return zero without allocating.
+
+#define MEM_MODEL_NUM_DDR4         4
+#define MEM_MODEL_DDR4_SIZE_LOG2   34    // 16 GB per DDR4
+#define MEM_MODEL_PAGE_SIZE_LOG2   12    // 4 KB pages
+#define MEM_MODEL_L2_BITS          11
+#define MEM_MODEL_L1_BITS          (MEM_MODEL_DDR4_SIZE_LOG2 - MEM_MODEL_PAGE_SIZE_LOG2 - MEM_MODEL_L2_BITS)
+
+#define MEM_MODEL_PAGE_SIZE        ((uint64_t) 1 << MEM_MODEL_PAGE_SIZE_LOG2)
+#define MEM_MODEL_DDR4_SIZE        ((uint64_t) 1 << MEM_MODEL_DDR4_SIZE_LOG2)
+#define MEM_MODEL_WORD_BYTES       64    // 512-bit AXI4 data bus
+
+typedef uint8_t  *Mem_Model_L2 [1 << MEM_MODEL_L2_BITS];
+
+static Mem_Model_L2  *mem_model_l1 [MEM_MODEL_NUM_DDR4][1 << MEM_MODEL_L1_BITS];
+
+static uint64_t  mem_model_n_pages = 0;
+
+// ================================================================
+// Return the page-table slot for the page containing byte_offset in
+// DDR4 ddr4_num.  If its second-level table does not exist: allocate
+// it if do_alloc, else return NULL.
+
+static
+uint8_t **mem_model_page_slot (uint8_t ddr4_num, uint64_t byte_offset, bool do_alloc)
+{
+    if ((ddr4_num >= MEM_MODEL_NUM_DDR4) || (byte_offset >= MEM_MODEL_DDR4_SIZE)) {
+	fprintf (stdout, "ERROR: mem_model_page: ddr4 %0d offset 0x%0" PRIx64 " out of bounds\n",
+		 ddr4_num, byte_offset);
+	exit (1);
+    }
+
+    uint64_t page_num = (byte_offset >> MEM_MODEL_PAGE_SIZE_LOG2);
+    uint64_t j1       = (page_num >> MEM_MODEL_L2_BITS);
+    uint64_t j2       = (page_num & ((1 << MEM_MODEL_L2_BITS) - 1));
+
+    Mem_Model_L2 *p_l2 = mem_model_l1 [ddr4_num][j1];
+    if (p_l2 == NULL) {
+	if (! do_alloc)
+	    return NULL;
+	p_l2 = (Mem_Model_L2 *) calloc (1, sizeof (Mem_Model_L2));
+	if (p_l2 == NULL) {
+	    fprintf (stdout, "ERROR: mem_model_page: unable to allocate page table\n");
+	    exit (1);
+	}
+	mem_model_l1 [ddr4_num][j1] = p_l2;
+    }
+    return & ((*p_l2) [j2]);
+}
+
+// ================================================================
+// Return the page containing byte_offset in DDR4 ddr4_num.
+// If it does not exist: allocate it if do_alloc, else return NULL.
+
+static
+uint8_t *mem_model_page (uint8_t ddr4_num, uint64_t byte_offset, bool do_alloc)
+{
+    uint8_t **p_slot = mem_model_page_slot (ddr4_num, byte_offset, do_alloc);
+    if (p_slot == NULL)
+	return NULL;
+
+    uint8_t *p_page = *p_slot;
+    if ((p_page == NULL) && do_alloc) {
+	p_page = (uint8_t *) calloc (1, MEM_MODEL_PAGE_SIZE);
+	if (p_page == NULL) {
+	    fprintf (stdout, "ERROR: mem_model_page: unable to allocate page\n");
+	    exit (1);
+	}
+	*p_slot = p_page;
+	mem_model_n_pages++;
+    }
+    return p_page;
+}
+
+// ================================================================
+// c_mem_model_read ()
+// Read the 64-byte word containing byte_offset in DDR4 ddr4_num into result.
+
+void c_mem_model_read (uint8_t *result, uint8_t ddr4_num, uint64_t byte_offset)
+{
+    TELEMETRY_BDPI_ENTER;
+    byte_offset &= (~ ((uint64_t) (MEM_MODEL_WORD_BYTES - 1)));
+
+    uint8_t *p_page = mem_model_page (ddr4_num, byte_offset, false);
+    if (p_page == NULL)
+	memset (result, 0, MEM_MODEL_WORD_BYTES);
+    else
+	memcpy (result, p_page + (byte_offset & (MEM_MODEL_PAGE_SIZE - 1)), MEM_MODEL_WORD_BYTES);
+
+    telemetry.ddr_rd_beats++;
+    TELEMETRY_BDPI_EXIT;
+}
+
+// ================================================================
+// c_mem_model_write ()
+// Write the bytes of 'data' enabled by 'strb' into the 64-byte word
+// containing byte_offset in DDR4 ddr4_num.
+
+void c_mem_model_write (uint8_t ddr4_num, uint64_t byte_offset, const uint8_t *data, uint64_t strb)
+{
+    telemetry.ddr_wr_beats++;
+    if (strb == 0)
+	return;
+
+    TELEMETRY_BDPI_ENTER;
+    byte_offset &= (~ ((uint64_t) (MEM_MODEL_WORD_BYTES - 1)));
+
+    uint8_t *p_page = mem_model_page (ddr4_num, byte_offset, true);
+    uint8_t *p      = p_page + (byte_offset & (MEM_MODEL_PAGE_SIZE - 1));
+
+    if (strb == 0xFFFFFFFFFFFFFFFFllu)
+	memcpy (p, data, MEM_MODEL_WORD_BYTES);
+    else {
+	for (int j = 0; j < MEM_MODEL_WORD_BYTES; j++)
+	    if (((strb >> j) & 1) != 0)
+		p [j] = data [j];
+    }
+    TELEMETRY_BDPI_EXIT;
+}
+
+// ================================================================
+// Optional DDR4 timing model.
+
+// Enabled if env var AWSTERIA_DDR4_TIMING names a config file with
+// lines of the form '<key> <value>' ('#' starts a comment):
+//     latency              fixed cycles added to every request
+//     banks                # of banks per DDR4
+//     row_bytes            bytes per row (row buffer size)
+//     row_hit_cycles       access cycles if the row is open
+//     row_miss_cycles      access cycles if the bank has no open row
+//     row_conflict_cycles  access cycles if another row is open
+//     bytes_per_cycle      bandwidth cap per DDR4 channel (0: none)
+// Keys not given keep the defaults below.
+// Statistics are printed at exit.
+
+#define MEM_TIMING_ENV_VAR       "AWSTERIA_DDR4_TIMING"
+#define MEM_TIMING_MAX_BANKS     64
+#define MEM_TIMING_QUEUE_WINDOW  64    // # of recent requests examined for queue occupancy
+
+typedef struct {
+    uint64_t  latency;
+    uint64_t  banks;
+    uint64_t  row_bytes;
+    uint64_t  row_hit_cycles;
+    uint64_t  row_miss_cycles;
+    uint64_t  row_conflict_cycles;
+    uint64_t  bytes_per_cycle;
+} Mem_Timing_Cfg;
+
+static Mem_Timing_Cfg  mem_timing_cfg = {.latency             = 20,
+					 .banks               = 16,
+					 .row_bytes           = 8192,
+					 .row_hit_cycles      = 14,
+					 .row_miss_cycles     = 28,
+					 .row_conflict_cycles = 42,
+					 .bytes_per_cycle     = 64};
+
+typedef struct {
+    // State
+    int64_t   open_row  [MEM_TIMING_MAX_BANKS];    // -1: none
+    uint64_t  bank_free [MEM_TIMING_MAX_BANKS];    // cycle at which bank can start next access
+    uint64_t  chan_free;                           // cycle at which data bus is next free
+    uint64_t  data_start [MEM_TIMING_QUEUE_WINDOW];  // of recent requests (ring)
+    uint64_t  n_reqs;
+
+    // Statistics
+    uint64_t  n_reads, n_writes, n_bytes;
+    uint64_t  n_row_hits, n_row_misses, n_row_conflicts;
+    uint64_t  sum_latency, max_latency;
+    uint64_t  sum_queue, max_queue;
+} Mem_Timing_Chan;
+
+static Mem_Timing_Chan  mem_timing_chans [MEM_MODEL_NUM_DDR4];
+
+// 0: not yet initialized; 1: disabled; 2: enabled
+static int mem_timing_state = 0;
+
+// ----------------
+
+static
+void mem_timing_report (void)
+{
+    fprintf (stdout, "DDR4 timing model statistics:\n");
+    for (int d = 0; d < MEM_MODEL_NUM_DDR4; d++) {
+	Mem_Timing_Chan *p = & (mem_timing_chans [d]);
+	if (p->n_reqs == 0) continue;
+	fprintf (stdout, "  DDR4 %0d: %0" PRId64 " reads, %0" PRId64 " writes, %0" PRId64 " bytes\n",
+		 d, p->n_reads, p->n_writes, p->n_bytes);
+	fprintf (stdout, "    Row hits %0" PRId64 ", misses %0" PRId64 ", conflicts %0" PRId64 "\n",
+		 p->n_row_hits, p->n_row_misses, p->n_row_conflicts);
+	fprintf (stdout, "    Latency (cycles):  avg %0.1f  max %0" PRId64 "\n",
+		 (double) p->sum_latency / p->n_reqs, p->max_latency);
+	fprintf (stdout, "    Queue occupancy:   avg %0.2f  max %0" PRId64 "\n",
+		 (double) p->sum_queue / p->n_reqs, p->max_queue);
+    }
+    fprintf (stdout, "  Memory model pages allocated: %0" PRId64 " (%0" PRId64 " KB)\n",
+	     mem_model_n_pages, (mem_model_n_pages * MEM_MODEL_PAGE_SIZE) / 1024);
+}
+
+static
+void mem_timing_init (void)
+{
+    mem_timing_state = 1;
+    char *filename = getenv (MEM_TIMING_ENV_VAR);
+    if ((filename == NULL) || (filename [0] == 0))
+	return;
+
+    FILE *fp = fopen (filename, "r");
+    if (fp == NULL) {
+	fprintf (stdout, "ERROR: mem_timing_init: unable to open %s file '%s'\n",
+		 MEM_TIMING_ENV_VAR, filename);
+	exit (1);
+    }
+
+    char      line [256], key [64];
+    uint64_t  val;
+    int       linenum = 0;
+    while (fgets (line, sizeof (line), fp) != NULL) {
+	linenum++;
+	char *p = strchr (line, '#');
+	if (p != NULL) *p = 0;
+	int n = sscanf (line, "%63s %" SCNu64, key, & val);
+	if (n <= 0)
+	    continue;
+	if (n != 2) {
+	    fprintf (stdout, "ERROR: %s line %0d: expecting '<key> <value>'\n", filename, linenum);
+	    exit (1);
+	}
+	if      (strcmp (key, "latency")             == 0) mem_timing_cfg.latency             = val;
+	else if (strcmp (key, "banks")               == 0) mem_timing_cfg.banks               = val;
+	else if (strcmp (key, "row_bytes")           == 0) mem_timing_cfg.row_bytes           = val;
+	else if (strcmp (key, "row_hit_cycles")      == 0) mem_timing_cfg.row_hit_cycles      = val;
+	else if (strcmp (key, "row_miss_cycles")     == 0) mem_timing_cfg.row_miss_cycles     = val;
+	else if (strcmp (key, "row_conflict_cycles") == 0) mem_timing_cfg.row_conflict_cycles = val;
+	else if (strcmp (key, "bytes_per_cycle")     == 0) mem_timing_cfg.bytes_per_cycle     = val;
+	else {
+	    fprintf (stdout, "ERROR: %s line %0d: unknown key '%s'\n", filename, linenum, key);
+	    exit (1);
+	}
+    }
+    fclose (fp);
+
+    if ((mem_timing_cfg.banks == 0) || (mem_timing_cfg.banks > MEM_TIMING_MAX_BANKS)
+	|| (mem_timing_cfg.row_bytes == 0)) {
+	fprintf (stdout, "ERROR: %s: banks must be 1..%0d and row_bytes non-zero\n",
+		 filename, MEM_TIMING_MAX_BANKS);
+	exit (1);
+    }
+
+    for (int d = 0; d < MEM_MODEL_NUM_DDR4; d++)
+	for (int b = 0; b < MEM_TIMING_MAX_BANKS; b++)
+	    mem_timing_chans [d].open_row [b] = -1;
+
+    fprintf (stdout, "DDR4 timing model (from %s):\n", filename);
+    fprintf (stdout, "    latency %0" PRId64 ", %0" PRId64 " banks x %0" PRId64 "-byte rows,"
+	     " row hit/miss/conflict %0" PRId64 "/%0" PRId64 "/%0" PRId64 ", %0" PRId64 " bytes/cycle\n",
+	     mem_timing_cfg.latency, mem_timing_cfg.banks, mem_timing_cfg.row_bytes,
+	     mem_timing_cfg.row_hit_cycles, mem_timing_cfg.row_miss_cycles,
+	     mem_timing_cfg.row_conflict_cycles, mem_timing_cfg.bytes_per_cycle);
+
+    atexit (mem_timing_report);
+    mem_timing_state = 2;
+}
+
+// ================================================================
+// c_mem_model_timing_req ()
+// A burst of n_beats 64-byte beats at byte_offset in DDR4 ddr4_num
+// arrives at 'cycle'.  Returns the cycle at which its first beat (read)
+// or its response (write) may be delivered.  If the timing model is
+// disabled, returns 'cycle'.
+
+uint64_t c_mem_model_timing_req (uint8_t   ddr4_num,
+				 uint8_t   is_write,
+				 uint64_t  byte_offset,
+				 uint32_t  n_beats,
+				 uint64_t  cycle)
+{
+    telemetry.ddr_reqs++;
+    if (mem_timing_state == 0)
+	mem_timing_init ();
+    if ((mem_timing_state != 2) || (ddr4_num >= MEM_MODEL_NUM_DDR4))
+	return cycle;
+
+    Mem_Timing_Cfg  *p_cfg = & mem_timing_cfg;
+    Mem_Timing_Chan *p     = & (mem_timing_chans [ddr4_num]);
+
+    // Bank and row
+    uint64_t row_num = byte_offset / p_cfg->row_bytes;
+    uint64_t bank    = row_num % p_cfg->banks;
+    int64_t  row     = row_num / p_cfg->banks;
+
+    uint64_t start = ((cycle < p->bank_free [bank]) ? p->bank_free [bank] : cycle);
+    uint64_t access;
+    if (p->open_row [bank] == row) {
+	access = p_cfg->row_hit_cycles;
+	p->n_row_hits++;
+    }
+    else if (p->open_row [bank] < 0) {
+	access = p_cfg->row_miss_cycles;
+	p->n_row_misses++;
+    }
+    else {
+	access = p_cfg->row_conflict_cycles;
+	p->n_row_conflicts++;
+    }
+    p->open_row  [bank] = row;
+    p->bank_free [bank] = start + access;
+
+    // Data transfer on the channel, limited by bandwidth
+    uint64_t n_bytes     = (uint64_t) n_beats * MEM_MODEL_WORD_BYTES;
+    uint64_t data_cycles = ((p_cfg->bytes_per_cycle == 0)
+			    ? 0
+			    : ((n_bytes + p_cfg->bytes_per_cycle - 1) / p_cfg->bytes_per_cycle));
+    uint64_t data_start  = start + access;
+    if (data_start < p->chan_free) data_start = p->chan_free;
+    p->chan_free = data_start + data_cycles;
+
+    uint64_t ready = data_start + p_cfg->latency;
+
+    // Queue occupancy: # of recent requests not yet started on the channel
+    uint64_t n_queued = 0;
+    uint64_t n_window = ((p->n_reqs < MEM_TIMING_QUEUE_WINDOW) ? p->n_reqs : MEM_TIMING_QUEUE_WINDOW);
+    for (uint64_t j = 0; j < n_window; j++)
+	if (p->data_start [j] > cycle)
+	    n_queued++;
+    p->data_start [p->n_reqs % MEM_TIMING_QUEUE_WINDOW] = data_start;
+
+    // Statistics
+    p->n_reqs++;
+    if (is_write) p->n_writes++; else p->n_reads++;
+    p->n_bytes     += n_bytes;
+    p->sum_latency += (ready - cycle);
+    if (p->max_latency < (ready - cycle)) p->max_latency = ready - cycle;
+    p->sum_queue   += n_queued;
+    if (p->max_queue < n_queued) p->max_queue = n_queued;
+
+    return ready;
+}
+
+// ================================================================
+// Backdoor preload of the memory model from an ELF or Mem-hex32 file.
+
+// Addresses in the file are the same as host DMA addresses (as used by
+// the host-side loaders): bits [35:34] select the DDR4, and the lower
+// 34 bits are the offset within it.
+
+#define MEM_PRELOAD_ENV_VAR  "AWSTERIA_PRELOAD"
+
+// ----------------
+// Write size bytes from src (zeroes if src is NULL) at host DMA address addr
+
+static
+void mem_preload_write (uint64_t addr, const uint8_t *src, uint64_t size)
+{
+    while (size != 0) {
+	uint8_t  ddr4_num = (addr >> MEM_MODEL_DDR4_SIZE_LOG2);
+	uint64_t offset   = (addr & (MEM_MODEL_DDR4_SIZE - 1));
+	uint64_t n        = MEM_MODEL_PAGE_SIZE - (offset & (MEM_MODEL_PAGE_SIZE - 1));
+	if (n > size) n = size;
+
+	uint8_t *p_page = mem_model_page (ddr4_num, offset, (src != NULL));
+	if (p_page != NULL) {
+	    uint8_t *p = p_page + (offset & (MEM_MODEL_PAGE_SIZE - 1));
+	    if (src != NULL)
+		memcpy (p, src, n);
+	    else
+		memset (p, 0, n);
+	}
+	if (src != NULL) src += n;
+	addr += n;
+	size -= n;
+    }
+}
+
+// ----------------
+// Load one PT_LOAD segment (called by elf_for_each_load_segment)
+
+static
+int mem_preload_segment (uint64_t seg_num, uint64_t paddr, const uint8_t *p_data,
+			 uint64_t filesz, uint64_t memsz, void *arg)
+{
+    fprintf (stdout, "    addr %16" PRIx64 " to addr %16" PRIx64 "\n", paddr, paddr + memsz);
+    mem_preload_write (paddr, p_data, filesz);
+    mem_preload_write (paddr + filesz, NULL, memsz - filesz);    // .bss
+    *((uint64_t *) arg) += memsz;
+    return 0;
+}
+
+// ----------------
+// Load the PT_LOAD segments of a 32-bit or 64-bit little-endian ELF file.
+// Return # of bytes loaded.
+
+static
+uint64_t mem_preload_elf (const char *filename, const uint8_t *p_file, uint64_t file_size)
+{
+    Elf_Hdr_Info hdr;
+    uint64_t     n_bytes = 0;
+    if ((elf_read_hdr ("mem_preload_elf", filename, p_file, file_size, & hdr) != 0)
+	|| (elf_for_each_load_segment ("mem_preload_elf", filename, p_file, file_size,
+				       & hdr, mem_preload_segment, & n_bytes) != 0))
+	exit (1);
+    return n_bytes;
+}
+
+// ----------------
+// Load a Mem-hex32 file, read with the host-side reader.
+// Extents are written in file order, so later ones override earlier ones.
+// Return # of bytes loaded.
+
+static
+uint64_t mem_preload_memhex32 (const char *filename)
+{
+    Memhex32_Image image;
+    if (memhex32_read_image (filename, 0, & image) != 0) {
+	fprintf (stdout, "ERROR: mem_preload_memhex32: unable to read '%s'\n", filename);
+	exit (1);
+    }
+    uint64_t n_bytes = 0;
+    for (uint64_t j = 0; j < image.n_extents; j++) {
+	mem_preload_write (image.extents [j].addr, image.extents [j].data, image.extents [j].size);
+	n_bytes += image.extents [j].size;
+    }
+    memhex32_image_free (& image);
+    return n_bytes;
+}
+
+// ================================================================
+// Snapshot and restore of the memory model.
+
+// See Mem_Snapshot.h for the file format.
+// On restore the file is mmap'd copy-on-write (MAP_PRIVATE) and the
+// page table points directly into the mapping, so restore is fast and
+// pages that are only read are never copied.
+
+static const uint8_t mem_zero_page [MEM_MODEL_PAGE_SIZE];
+
+// ----------------
+// Call f on each non-zero page of the memory model
+
+static
+void mem_model_for_each_page (void (*f) (uint8_t ddr4_num, uint64_t byte_offset, uint8_t *p_page, void *arg),
+			      void *arg)
+{
+    for (uint8_t d = 0; d < MEM_MODEL_NUM_DDR4; d++)
+	for (uint64_t j1 = 0; j1 < (1 << MEM_MODEL_L1_BITS); j1++) {
+	    Mem_Model_L2 *p_l2 = mem_model_l1 [d][j1];
+	    if (p_l2 == NULL) continue;
+	    for (uint64_t j2 = 0; j2 < (1 << MEM_MODEL_L2_BITS); j2++) {
+		uint8_t *p_page = (*p_l2) [j2];
+		if ((p_page == NULL) || (memcmp (p_page, mem_zero_page, MEM_MODEL_PAGE_SIZE) == 0))
+		    continue;
+		uint64_t page_num = (j1 << MEM_MODEL_L2_BITS) | j2;
+		f (d, page_num << MEM_MODEL_PAGE_SIZE_LOG2, p_page, arg);
+	    }
+	}
+}
+
+static
+void mem_snapshot_count_page (uint8_t ddr4_num, uint64_t byte_offset, uint8_t *p_page, void *arg)
+{
+    (* (uint64_t *) arg)++;
+}
+
+static
+void mem_snapshot_write_entry (uint8_t ddr4_num, uint64_t byte_offset, uint8_t *p_page, void *arg)
+{
+    Mem_Snapshot_Entry entry = {.ddr4_num = ddr4_num, .byte_offset = byte_offset};
+    if (fwrite (& entry, sizeof (entry), 1, (FILE *) arg) != 1) {
+	fprintf (stdout, "ERROR: mem_snapshot_save: write failed\n");
+	exit (1);
+    }
+}
+
+static
+void mem_snapshot_write_page (uint8_t ddr4_num, uint64_t byte_offset, uint8_t *p_page, void *arg)
+{
+    if (fwrite (p_page, MEM_MODEL_PAGE_SIZE, 1, (FILE *) arg) != 1) {
+	fprintf (stdout, "ERROR: mem_snapshot_save: write failed\n");
+	exit (1);
+    }
+}
+
+// ----------------
+// Save the memory model to a snapshot file.
+// The file is written under a temporary name and then renamed, so that
+// an earlier snapshot of the same name that is still mapped by
+// mem_snapshot_restore_file is not modified underneath us.
+
+static
+void mem_snapshot_save_file (const char *filename)
+{
+    char tmp_filename [1024];
+    snprintf (tmp_filename, sizeof (tmp_filename), "%s.tmp", filename);
+
+    FILE *fp = fopen (tmp_filename, "w");
+    if (fp == NULL) {
+	fprintf (stdout, "ERROR: mem_snapshot_save: unable to open '%s'\n", tmp_filename);
+	return;
+    }
+
+    Mem_Snapshot_Hdr hdr;
+    memset (& hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, MEM_SNAPSHOT_MAGIC, sizeof (hdr.magic));
+    hdr.version   = MEM_SNAPSHOT_VERSION;
+    hdr.page_size = MEM_MODEL_PAGE_SIZE;
+    mem_model_for_each_page (mem_snapshot_count_page, & hdr.n_pages);
+
+    uint64_t index_end = sizeof (hdr) + (hdr.n_pages * sizeof (Mem_Snapshot_Entry));
+    hdr.data_offset = ((index_end + MEM_MODEL_PAGE_SIZE - 1) & (~ (MEM_MODEL_PAGE_SIZE - 1)));
+
+    if (fwrite (& hdr, sizeof (hdr), 1, fp) != 1) {
+	fprintf (stdout, "ERROR: mem_snapshot_save: write failed\n");
+	exit (1);
+    }
+    mem_model_for_each_page (mem_snapshot_write_entry, fp);
+    if (fwrite (mem_zero_page, hdr.data_offset - index_end, 1, fp) != 1) {
+	fprintf (stdout, "ERROR: mem_snapshot_save: write failed\n");
+	exit (1);
+    }
+    mem_model_for_each_page (mem_snapshot_write_page, fp);
+    if ((fclose (fp) != 0) || (rename (tmp_filename, filename) < 0)) {
+	fprintf (stdout, "ERROR: mem_snapshot_save: unable to write '%s'\n", filename);
+	exit (1);
+    }
+
+    fprintf (stdout, "mem_snapshot_save: saved %0" PRId64 " pages to '%s'\n", hdr.n_pages, filename);
+}
+
+// ----------------
+// Save the memory model to the file named by AWSTERIA_DDR_SNAPSHOT (at exit)
+
+static
+void mem_snapshot_save (void)
+{
+    char *filename = getenv (MEM_SNAPSHOT_ENV_VAR);
+    if ((filename == NULL) || (filename [0] == 0))
+	return;
+    mem_snapshot_save_file (filename);
+}
+
+// ----------------
+// Restore the memory model from a snapshot file.
+
+static
+void mem_snapshot_restore_file (const char *filename)
+{
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0) {
+	fprintf (stdout, "ERROR: mem_snapshot_restore: unable to open DDR snapshot file '%s'\n",
+		 filename);
+	exit (1);
+    }
+    struct stat st;
+    Mem_Snapshot_Hdr hdr;
+    if ((fstat (fd, & st) < 0)
+	|| (st.st_size < sizeof (hdr))
+	|| (read (fd, & hdr, sizeof (hdr)) != sizeof (hdr))
+	|| (memcmp (hdr.magic, MEM_SNAPSHOT_MAGIC, sizeof (hdr.magic)) != 0)
+	|| (hdr.version != MEM_SNAPSHOT_VERSION)
+	|| (hdr.page_size != MEM_MODEL_PAGE_SIZE)
+	|| ((hdr.data_offset & (MEM_MODEL_PAGE_SIZE - 1)) != 0)
+	|| ((hdr.data_offset + (hdr.n_pages * MEM_MODEL_PAGE_SIZE)) != st.st_size)) {
+	fprintf (stdout, "ERROR: mem_snapshot_restore: '%s' is not a valid DDR snapshot file\n",
+		 filename);
+	exit (1);
+    }
+
+    // Copy-on-write mapping: model writes do not modify the file
+    uint8_t *p_file = (uint8_t *) mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (p_file == MAP_FAILED) {
+	fprintf (stdout, "ERROR: mem_snapshot_restore: unable to mmap '%s'\n", filename);
+	exit (1);
+    }
+
+    Mem_Snapshot_Entry *entries = (Mem_Snapshot_Entry *) (p_file + sizeof (hdr));
+    for (uint64_t j = 0; j < hdr.n_pages; j++) {
+	uint8_t  *p_data = p_file + hdr.data_offset + (j * MEM_MODEL_PAGE_SIZE);
+	uint8_t **p_slot = mem_model_page_slot (entries [j].ddr4_num, entries [j].byte_offset, true);
+	if (*p_slot != NULL)
+	    memcpy (*p_slot, p_data, MEM_MODEL_PAGE_SIZE);
+	else {
+	    *p_slot = p_data;
+	    mem_model_n_pages++;
+	}
+    }
+    // The mapping stays for the life of the simulation.
+
+    fprintf (stdout, "mem_snapshot_restore: restored %0" PRId64 " pages from '%s'\n",
+	     hdr.n_pages, filename);
+}
+
+// ----------------
+// Restore the memory model from the file named by AWSTERIA_DDR_RESTORE.
+// Return 1 if restored, 0 if env var not set.
+
+static
+uint32_t mem_snapshot_restore (void)
+{
+    char *filename = getenv (MEM_RESTORE_ENV_VAR);
+    if ((filename == NULL) || (filename [0] == 0))
+	return 0;
+    mem_snapshot_restore_file (filename);
+    return 1;
+}
+
+// ================================================================
+// c_mem_model_preload ()
+// If env var AWSTERIA_DDR_RESTORE names a snapshot file, restore it;
+// then, if env var AWSTERIA_PRELOAD names an ELF or Mem-hex32 file,
+// load it directly into the memory model.
+// Also arranges to save a snapshot at exit if AWSTERIA_DDR_SNAPSHOT is set.
+// Returns 1 if anything was loaded, 0 if not.
+
+uint32_t c_mem_model_preload (uint8_t dummy)
+{
+    char *snapshot_filename = getenv (MEM_SNAPSHOT_ENV_VAR);
+    if ((snapshot_filename != NULL) && (snapshot_filename [0] != 0))
+	atexit (mem_snapshot_save);
+
+    uint32_t restored = mem_snapshot_restore ();
+
+    char *filename = getenv (MEM_PRELOAD_ENV_VAR);
+    if ((filename == NULL) || (filename [0] == 0))
+	return restored;
+
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0) {
+	fprintf (stdout, "ERROR: c_mem_model_preload: unable to open %s file '%s'\n",
+		 MEM_PRELOAD_ENV_VAR, filename);
+	exit (1);
+    }
+    struct stat st;
+    if (fstat (fd, & st) < 0) {
+	fprintf (stdout, "ERROR: c_mem_model_preload: unable to stat '%s'\n", filename);
+	exit (1);
+    }
+    uint64_t file_size = st.st_size;
+    const uint8_t *p_file = NULL;
+    if (file_size != 0) {
+	p_file = (const uint8_t *) mmap (NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p_file == MAP_FAILED) {
+	    fprintf (stdout, "ERROR: c_mem_model_preload: unable to mmap '%s'\n", filename);
+	    exit (1);
+	}
+    }
+    close (fd);
+
+    uint64_t n_bytes;
+    if ((file_size >= EI_NIDENT) && (memcmp (p_file, ELFMAG, SELFMAG) == 0)) {
+	fprintf (stdout, "c_mem_model_preload: loading ELF file '%s'\n", filename);
+	n_bytes = mem_preload_elf (filename, p_file, file_size);
+	munmap ((void *) p_file, file_size);
+    }
+    else {
+	if (p_file != NULL)
+	    munmap ((void *) p_file, file_size);
+	fprintf (stdout, "c_mem_model_preload: loading Mem-hex32 file '%s'\n", filename);
+	n_bytes = mem_preload_memhex32 (filename);
+    }
+
+    fprintf (stdout, "c_mem_model_preload: loaded %0" PRId64 " bytes (%0" PRId64 " pages allocated)\n",
+	     n_bytes, mem_model_n_pages);
+    return 1;
+}
+
+// ****************************************************************
+// ****************************************************************
+// ****************************************************************
+
+// Functions for simulation checkpoint/restore.
+// These are not imported into BSV; they are called from the Verilator
+// driver (sim_main.cpp) alongside its save/restore of the model state.
+
+// A checkpoint named <file> consists of:
+//     <file>           Verilator model state (written by sim_main.cpp)
+//     <file>.c_state   state of the functions in this file
+//     <file>.ddr4      memory model snapshot (see mem_snapshot_save_file)
+// The host connection itself cannot be saved: on restore we wait for a
+// new host-side connection, on the same TCP port or shared-memory name.
+// Bytevecs received from the host but not yet consumed by BSV (over TCP
+// or shared memory) are saved, and are replayed ahead of anything from
+// the new connection.
+
+#define CKPT_MAGIC    "AWSCKPTS"
+#define CKPT_VERSION  3
+
+typedef struct {
+    char             magic [8];
+    uint32_t         version;
+
+    // Host communication
+    uint8_t          host_connected;
+    uint8_t          use_shm;
+    uint16_t         port;
+    uint32_t         recv_buf_n;       // # of staged received bytes that follow
+    uint64_t         host_cycles;
+
+    // Trace file
+    uint8_t            trace_file_is_open;
+    uint8_t            trace_compress_level;
+    uint64_t           trace_file_offset;    // file size (compressed, if compressed)
+    uint64_t           trace_file_size;
+    uint64_t           trace_file_writes;
+    uint64_t           trace_segment_records;
+    uint64_t           trace_index_offset;
+    uint64_t           trace_segment_file_offset;
+    Trace_Index_Entry  trace_segment;
+
+    // Memory timing model
+    int32_t          mem_timing_state;
+    Mem_Timing_Cfg   mem_timing_cfg;
+    Mem_Timing_Chan  mem_timing_chans [MEM_MODEL_NUM_DDR4];
+} Ckpt_State;
+
+// ----------------
+// # of bytes of complete bytevecs in a receive ring (with SHM, the host
+// may be part way through writing the last one)
+
+static
+uint32_t ckpt_recv_ring_complete_bytes (SHM_Ring *p_ring)
+{
+    uint64_t used = shm_ring_used (p_ring);
+    uint64_t n    = 0;
+    while (n < used) {
+	uint8_t data_size = shm_ring_peek (p_ring, n);
+	if ((data_size == 0) || ((n + data_size) > used))
+	    break;
+	n += data_size;
+    }
+    return (uint32_t) n;
+}
+
+// ================================================================
+// c_checkpoint_save ()
+// Save C-side state for a checkpoint named 'filename'.
+
+void c_checkpoint_save (const char *filename)
+{
+    char c_filename [1024];
+
+    // Push out any staged bytevecs: they belong to the current host session
+    if ((! use_shm) && host_send_thread_running)
+	host_send_drain ();
+
+    Ckpt_State  state;
+    memset (& state, 0, sizeof (state));
+    memcpy (state.magic, CKPT_MAGIC, sizeof (state.magic));
+    state.version               = CKPT_VERSION;
+    state.host_connected        = host_connected;
+    state.use_shm               = use_shm;
+    state.port                  = port;
+    // Received bytevecs not yet consumed by BSV, over either transport:
+    // those in host_recv_ring (TCP, or restored), then those in the SHM ring
+    uint32_t  n_recv_staged = ((host_recv_ring != NULL)
+			       ? ckpt_recv_ring_complete_bytes (host_recv_ring)
+			       : 0);
+    uint32_t  n_recv_shm    = ((use_shm && (p_ring_from_host != NULL))
+			       ? ckpt_recv_ring_complete_bytes (p_ring_from_host)
+			       : 0);
+    state.recv_buf_n            = n_recv_staged + n_recv_shm;
+    if (state.recv_buf_n > HOST_RECV_RING_SIZE) {
+	fprintf (stdout, "ERROR: c_checkpoint_save: %0d received bytes pending (max %0lld)\n",
+		 state.recv_buf_n, HOST_RECV_RING_SIZE);
+	exit (1);
+    }
+    state.host_cycles           = host_cycles;
+    state.trace_file_is_open    = ((trace_file_stream != NULL) || (trace_file_gz != NULL)
+				   || (trace_shm_hdr != NULL));
+    state.trace_compress_level  = trace_compress_level;
+    state.trace_file_size       = trace_file_size;
+    state.trace_file_writes     = trace_file_writes;
+    state.trace_segment_records = trace_segment_records;
+    state.trace_segment         = trace_segment;
+    state.mem_timing_state      = mem_timing_state;
+    state.mem_timing_cfg        = mem_timing_cfg;
+    memcpy (state.mem_timing_chans, mem_timing_chans, sizeof (mem_timing_chans));
+
+    // Write out the trace so far.  A compressed trace is ended here (the
+    // gzip format allows further members to be appended after restore).
+    // A trace streamed to a checker continues to a new checker (connected
+    // on restore), which must start from the checkpoint.
+    if ((trace_file_stream != NULL) || (trace_file_gz != NULL)) {
+	trace_flush ();
+	if (trace_file_gz != NULL) {
+	    gzflush (trace_file_gz, Z_FINISH);
+	    state.trace_file_offset = gzoffset (trace_file_gz);
+	}
+	else {
+	    fflush (trace_file_stream);
+	    state.trace_file_offset = trace_file_size;
+	}
+	if (trace_index_stream != NULL) {
+	    fflush (trace_index_stream);
+	    state.trace_index_offset = ftello (trace_index_stream);
+	}
+	state.trace_segment_file_offset = trace_segment_file_offset;
+    }
+
+    snprintf (c_filename, sizeof (c_filename), "%s.c_state", filename);
+    FILE *fp = fopen (c_filename, "w");
+    if (fp == NULL) {
+	fprintf (stdout, "ERROR: c_checkpoint_save: unable to open '%s'\n", c_filename);
+	exit (1);
+    }
+    // Received bytevecs, left in the ring (the other end only appends)
+    bool ok = (fwrite (& state, sizeof (state), 1, fp) == 1);
+    for (uint32_t j = 0; ok && (j < n_recv_staged); j++)
+	ok = (fputc (shm_ring_peek (host_recv_ring, j), fp) != EOF);
+    for (uint32_t j = 0; ok && (j < n_recv_shm); j++)
+	ok = (fputc (shm_ring_peek (p_ring_from_host, j), fp) != EOF);
+    if ((! ok) || (fclose (fp) != 0)) {
+	fprintf (stdout, "ERROR: c_checkpoint_save: unable to write '%s'\n", c_filename);
+	exit (1);
+    }
+
+    snprintf (c_filename, sizeof (c_filename), "%s.ddr4", filename);
+    mem_snapshot_save_file (c_filename);
+
+    fprintf (stdout, "c_checkpoint_save: saved C state to '%s.*'\n", filename);
+}
+
+// ================================================================
+// c_checkpoint_restore ()
+// Restore C-side state from a checkpoint named 'filename' into a
+// freshly started simulation, and reconnect to the host.
+
+void c_checkpoint_restore (const char *filename)
+{
+    char c_filename [1024];
+
+    snprintf (c_filename, sizeof (c_filename), "%s.c_state", filename);
+    FILE *fp = fopen (c_filename, "r");
+    if (fp == NULL) {
+	fprintf (stdout, "ERROR: c_checkpoint_restore: unable to open '%s'\n", c_filename);
+	exit (1);
+    }
+    Ckpt_State  state;
+    uint8_t    *recv_bytes = (uint8_t *) malloc (HOST_RECV_RING_SIZE);
+    if ((recv_bytes == NULL)
+	|| (fread (& state, sizeof (state), 1, fp) != 1)
+	|| (memcmp (state.magic, CKPT_MAGIC, sizeof (state.magic)) != 0)
+	|| (state.version != CKPT_VERSION)
+	|| (state.recv_buf_n > HOST_RECV_RING_SIZE)
+	|| (fread (recv_bytes, 1, state.recv_buf_n, fp) != state.recv_buf_n)) {
+	fprintf (stdout, "ERROR: c_checkpoint_restore: '%s' is not a valid checkpoint file\n",
+		 c_filename);
+	exit (1);
+    }
+    fclose (fp);
+    // Saved bytevecs go ahead of anything from the new connection
+    // (over SHM too: host_recv takes them from host_recv_ring first)
+    host_recv_ring_alloc ();
+    shm_ring_put (host_recv_ring, recv_bytes, state.recv_buf_n);
+    free (recv_bytes);
+
+    // Memory model and timing model
+    snprintf (c_filename, sizeof (c_filename), "%s.ddr4", filename);
+    mem_snapshot_restore_file (c_filename);
+
+    mem_timing_state = state.mem_timing_state;
+    mem_timing_cfg   = state.mem_timing_cfg;
+    memcpy (mem_timing_chans, state.mem_timing_chans, sizeof (mem_timing_chans));
+    if (mem_timing_state == 2)
+	atexit (mem_timing_report);
+
+    char *snapshot_filename = getenv (MEM_SNAPSHOT_ENV_VAR);
+    if ((snapshot_filename != NULL) && (snapshot_filename [0] != 0))
+	atexit (mem_snapshot_save);
+
+    // Trace file: reopen and discard anything written after the checkpoint
+    host_cycles               = state.host_cycles;
+    trace_file_size           = state.trace_file_size;
+    trace_file_writes         = state.trace_file_writes;
+    trace_compress_level      = state.trace_compress_level;
+    trace_segment_records     = state.trace_segment_records;
+    trace_segment             = state.trace_segment;
+    trace_segment_file_offset = state.trace_segment_file_offset;
+    if (state.trace_file_is_open
+	&& (! trace_file_start ((int64_t) state.trace_file_offset,
+				(int64_t) state.trace_index_offset))) {
+	fprintf (stdout, "ERROR: c_checkpoint_restore: unable to reopen trace file '%s' at offset %0" PRId64 "\n",
+		 trace_file_name, state.trace_file_offset);
+	exit (1);
+    }
+
+    fprintf (stdout, "c_checkpoint_restore: restored C state from '%s.*'\n", filename);
+
+    // Host communication
+    if (state.host_connected)
+	c_host_connect (state.port);
+}
+
+// ****************************************************************
+// ****************************************************************
+// ****************************************************************
@@ -64,6 +64,9 @@ void c_host_recv (uint8_t *bytevec, uint8_t bytevec_size);
 extern
 void c_host_send (const uint8_t *bytevec, uint8_t bytevec_size);
 
+extern
+void c_host_flush (uint8_t dummy);
+
 // ****************************************************************
 // ****************************************************************
 // ****************************************************************
@@ -109,6 +112,80 @@ uint32_t c_trace_file_close (uint8_t dummy);
 // ****************************************************************
 // ****************************************************************
 
+// Functions for the AWS DDR4 memory model (AWS_DDR4_Model.bsv).
+// Sparse storage: 4 KB pages allocated on first write; untouched
+// memory reads as zero.
+
+// ================================================================
+// c_mem_model_read ()
+// Read the 64-byte word containing byte_offset in DDR4 ddr4_num into result.
+
+extern
+void c_mem_model_read (uint8_t *result, uint8_t ddr4_num, uint64_t byte_offset);
+
+// ================================================================
+// c_mem_model_write ()
+// Write the bytes of 'data' enabled by 'strb' into the 64-byte word
+// containing byte_offset in DDR4 ddr4_num.
+
+extern
+void c_mem_model_write (uint8_t ddr4_num, uint64_t byte_offset, const uint8_t *data, uint64_t strb);
+
+// ================================================================
+// c_mem_model_timing_req ()
+// Optional timing model (enabled by env var AWSTERIA_DDR4_TIMING).
+// A burst of n_beats 64-byte beats at byte_offset in DDR4 ddr4_num
+// arrives at 'cycle'.  Returns the cycle at which its first beat (read)
+// or its response (write) may be delivered ('cycle' if disabled).
+
+extern
+uint64_t c_mem_model_timing_req (uint8_t   ddr4_num,
+				 uint8_t   is_write,
+				 uint64_t  byte_offset,
+				 uint32_t  n_beats,
+				 uint64_t  cycle);
+
+// ================================================================
+// c_mem_model_preload ()
+// If env var AWSTERIA_DDR_RESTORE names a DDR snapshot file, restore it
+// (mmap'd copy-on-write); then, if env var AWSTERIA_PRELOAD names an ELF
+// or Mem-hex32 file, load it directly into the memory model (file
+// addresses are host DMA addresses).
+// If env var AWSTERIA_DDR_SNAPSHOT names a file, the memory model is
+// saved to it at exit.
+// Returns 1 if anything was loaded, 0 if not.
+
+extern
+uint32_t c_mem_model_preload (uint8_t dummy);
+
+// ****************************************************************
+// ****************************************************************
+// ****************************************************************
+
+// Functions for simulation checkpoint/restore.
+// These are not imported into BSV; they are called from the Verilator
+// driver (sim_main.cpp) alongside its save/restore of the model state.
+
+// ================================================================
+// c_checkpoint_save ()
+// Save C-side state (host comms, trace file offset, memory and timing
+// models) to files <filename>.c_state and <filename>.ddr4
+
+extern
+void c_checkpoint_save (const char *filename);
+
+// ================================================================
+// c_checkpoint_restore ()
+// Restore C-side state saved by c_checkpoint_save into a freshly
+// started simulation, and reconnect to the host.
+
+extern
+void c_checkpoint_restore (const char *filename);
+
+// ****************************************************************
+// ****************************************************************
+// ****************************************************************
+
 #ifdef __cplusplus
 }
 #endif
@@ -71,6 +71,13 @@ def Gen_C  (spec_filename,
     file_h.write (h_txt)
     file_c.write (c_txt)
 
+    # ----------------
+    (h_txt, c_txt) = gen_struct_to_bytevec_batch_function (package_name,
+                                                           C_to_BSV_structs, C_to_BSV_packet_bytes,
+                                                           BSV_to_C_structs, BSV_to_C_packet_bytes)
+    file_h.write (h_txt)
+    file_c.write (c_txt)
+
     # ----------------
     (h_txt, c_txt) = gen_struct_from_bytevec_function (package_name,
                                                        C_to_BSV_structs, C_to_BSV_packet_bytes,
@@ -78,6 +85,13 @@ def Gen_C  (spec_filename,
     file_h.write (h_txt)
     file_c.write (c_txt)
 
+    # ----------------
+    (h_txt, c_txt) = gen_struct_from_bytevec_batch_function (package_name,
+                                                             C_to_BSV_structs, C_to_BSV_packet_bytes,
+                                                             BSV_to_C_structs, BSV_to_C_packet_bytes)
+    file_h.write (h_txt)
+    file_c.write (c_txt)
+
     # ----------------
     (h_txt, c_txt) = gen_C_to_BSV_API_enqueue_functions (package_name,
                                                          C_to_BSV_structs, C_to_BSV_packet_bytes,
@@ -231,6 +245,20 @@ def gen_comm_state_decls (package_name,
               "#define BSV_TO_C_FIFO_SIZE        0x80\n" +
               "#define BSV_TO_C_FIFO_INDEX_MASK  0x7F\n" +
               "\n" +
+              "// Max bytes in a batch of C to BSV packets: every C to BSV queue\n" +
+              "// full, with credits, plus one credits-only packet\n" +
+              ("#define C_TO_BSV_BATCH_BYTES      ({:d} * C_TO_BSV_FIFO_SIZE * {:d} + {:d})\n".
+               format (len (C_to_BSV_structs),
+                       total_packet_size_bytes (C_to_BSV_packet_bytes),
+                       total_packet_size_bytes (C_to_BSV_packet_bytes))) +
+              "\n" +
+              "// Max bytes in a batch of BSV to C packets: every BSV to C queue\n" +
+              "// full, plus one credits-only packet\n" +
+              ("#define BSV_TO_C_BATCH_BYTES      ({:d} * BSV_TO_C_FIFO_SIZE * {:d} + {:d})\n".
+               format (len (BSV_to_C_structs),
+                       total_packet_size_bytes (BSV_to_C_packet_bytes),
+                       total_packet_size_bytes (BSV_to_C_packet_bytes))) +
+              "\n" +
               "typedef struct {\n")
 
     h_txt += "   // C to BSV queues\n"
@@ -260,6 +288,15 @@ def gen_comm_state_decls (package_name,
                format (total_packet_size_bytes (C_to_BSV_packet_bytes))) +
               ("    uint8_t bytevec_BSV_to_C [{:d}];\n".
                format (total_packet_size_bytes (BSV_to_C_packet_bytes))))
+    h_txt += ("\n" +
+              "    // Batch of C to BSV packets (concatenated bytevecs)\n" +
+              "    uint8_t  bytevec_C_to_BSV_batch [C_TO_BSV_BATCH_BYTES];\n" +
+              "    uint32_t bytevec_C_to_BSV_batch_size;\n" +
+              "\n" +
+              "    // Batch of BSV to C packets (concatenated bytevecs, possibly\n" +
+              "    // ending with a partial packet)\n" +
+              "    uint8_t  bytevec_BSV_to_C_batch [BSV_TO_C_BATCH_BYTES];\n" +
+              "    uint32_t bytevec_BSV_to_C_batch_size;\n")
     h_txt += "}} {:s};\n".format (state_type)
 
     x = ("\n" +
@@ -402,6 +439,60 @@ def gen_struct_to_bytevec_function (package_name,
                       ("@CHAN_ID_INDEX",   "{:d}".format (1 + len (BSV_to_C_structs))) ])
     return (h_txt, c_txt)
 
+# ================================================================
+# Generate struct_to_bytevec_batch function
+
+x = ["",
+     "// ================================================================",
+     "// C to BSV struct->bytevec batch encoder",
+     "// Encodes every ready struct (up to available credits) into",
+     "// p_state->bytevec_C_to_BSV_batch, as a sequence of ordinary packets,",
+     "// so that they can all be sent together.",
+     "// Credits are carried by the first packet only.",
+     "// Returns # of bytes in the batch (0 if nothing to send)",
+     ""]
+
+h_template_struct_to_bytevec_batch_function = (
+    x +
+    ["extern",
+     "int @PKG_struct_to_bytevec_batch (@PKG_state *p_state);",
+     ""])
+
+c_template_struct_to_bytevec_batch_function = (
+    x +
+    ["int @PKG_struct_to_bytevec_batch (@PKG_state *p_state)",
+     "{",
+     "    int verbosity2 = 0;    // local verbosity for this function",
+     "",
+     "    uint32_t n_bytes = 0;",
+     "    uint32_t n_pkts  = 0;",
+     "    while ((n_bytes + @PKT_SIZE_MAX) <= C_TO_BSV_BATCH_BYTES) {",
+     "        if (! @PKG_struct_to_bytevec (p_state)) break;",
+     "",
+     "        uint8_t size = p_state->bytevec_C_to_BSV [0];",
+     "        memcpy (p_state->bytevec_C_to_BSV_batch + n_bytes, p_state->bytevec_C_to_BSV, size);",
+     "        n_bytes += size;",
+     "        n_pkts  += 1;",
+     "    }",
+     "    p_state->bytevec_C_to_BSV_batch_size = n_bytes;",
+     "",
+     "    if ((verbosity2 != 0) && (n_pkts != 0))",
+     '        fprintf (stdout, "@PKG_struct_to_bytevec_batch: %0d packets, %0d bytes\\n", n_pkts, n_bytes);',
+     "    return n_bytes;",
+     "}",
+     ""])
+
+def gen_struct_to_bytevec_batch_function (package_name,
+                                          C_to_BSV_structs, C_to_BSV_packet_bytes,
+                                          BSV_to_C_structs, BSV_to_C_packet_bytes):
+    h_txt = subst (h_template_struct_to_bytevec_batch_function,
+                   [ ("@PKG", package_name) ])
+
+    c_txt = subst (c_template_struct_to_bytevec_batch_function,
+                   [ ("@PKG", package_name),
+                     ("@PKT_SIZE_MAX", "{:d}".format (total_packet_size_bytes (C_to_BSV_packet_bytes))) ])
+    return (h_txt, c_txt)
+
 # ================================================================
 # Generate struct_from_bytevec function
 
@@ -439,8 +530,9 @@ c_template_struct_from_bytevec_function_decode = [
     "    // BSV to C: @BSV_TO_C_STRUCT",
     "    if (p_state->bytevec_BSV_to_C [@CHAN_ID_INDEX] == @THIS_CHAN_ID) {",
     "        // ---- Fill in struct from payload",
-    "        uint64_t head_index = (p_state->head_@BSV_TO_C_STRUCT & BSV_TO_C_FIFO_INDEX_MASK);",
-    "        @BSV_TO_C_STRUCT_from_bytevec (& p_state->buf_@BSV_TO_C_STRUCT [head_index],",
+    "        uint64_t tail_index = ((p_state->head_@BSV_TO_C_STRUCT + p_state->size_@BSV_TO_C_STRUCT)",
+    "                               & BSV_TO_C_FIFO_INDEX_MASK);",
+    "        @BSV_TO_C_STRUCT_from_bytevec (& p_state->buf_@BSV_TO_C_STRUCT [tail_index],",
     "                                       p_state->bytevec_BSV_to_C + @CHAN_ID_INDEX + 1);",
     "        // ---- Enqueue the struct",
     "        p_state->size_@BSV_TO_C_STRUCT += 1;",
@@ -485,6 +577,75 @@ def gen_struct_from_bytevec_function (package_name,
                     [ ("@PKG", package_name) ])
     return (h_txt, c_txt)
 
+# ================================================================
+# Generate struct_from_bytevec_batch function
+
+x = ["",
+     "// ================================================================",
+     "// BSV to C bytevec->struct batch decoder",
+     "// p_state->bytevec_BSV_to_C_batch contains bytevec_BSV_to_C_batch_size",
+     "// bytes: a sequence of packets, possibly ending with a partial packet.",
+     "// Decodes every complete packet and moves the partial packet (if any)",
+     "// to the front of the batch buffer.",
+     "// A packet whose size byte is below the header size or above the",
+     "// max packet size means the stream is out of sync: exit with an error.",
+     "// Returns # of packets decoded",
+     ""]
+
+h_template_struct_from_bytevec_batch_function = (
+    x +
+    ["extern",
+     "int @PKG_struct_from_bytevec_batch (@PKG_state *p_state);",
+     ""])
+
+c_template_struct_from_bytevec_batch_function = (
+    x +
+    ["int @PKG_struct_from_bytevec_batch (@PKG_state *p_state)",
+     "{",
+     "    int verbosity2 = 0;    // local verbosity for this function",
+     "",
+     "    uint32_t n_bytes = p_state->bytevec_BSV_to_C_batch_size;",
+     "    uint32_t offset  = 0;",
+     "    uint32_t n_pkts  = 0;",
+     "    while (offset < n_bytes) {",
+     "        uint8_t size = p_state->bytevec_BSV_to_C_batch [offset];",
+     "        if ((size < @HDR_BYTES) || (size > @MAX_BYTES)) {",
+     '            fprintf (stdout, "ERROR: @PKG_struct_from_bytevec_batch: bad packet size %0d (expecting @HDR_BYTES..@MAX_BYTES)\\n",',
+     "                     size);",
+     "            exit (1);",
+     "        }",
+     "        if ((n_bytes - offset) < size) break;",
+     "",
+     "        memcpy (p_state->bytevec_BSV_to_C, p_state->bytevec_BSV_to_C_batch + offset, size);",
+     "        @PKG_struct_from_bytevec (p_state);",
+     "        offset += size;",
+     "        n_pkts += 1;",
+     "    }",
+     "",
+     "    // Keep the partial packet, if any",
+     "    memmove (p_state->bytevec_BSV_to_C_batch,",
+     "             p_state->bytevec_BSV_to_C_batch + offset,",
+     "             n_bytes - offset);",
+     "    p_state->bytevec_BSV_to_C_batch_size = n_bytes - offset;",
+     "",
+     "    if ((verbosity2 != 0) && (n_pkts != 0))",
+     '        fprintf (stdout, "@PKG_struct_from_bytevec_batch: %0d packets, %0d bytes\\n", n_pkts, offset);',
+     "    return n_pkts;",
+     "}",
+     ""])
+
+def gen_struct_from_bytevec_batch_function (package_name,
+                                            C_to_BSV_structs, C_to_BSV_packet_bytes,
+                                            BSV_to_C_structs, BSV_to_C_packet_bytes):
+    h_txt = subst (h_template_struct_from_bytevec_batch_function,
+                   [ ("@PKG", package_name) ])
+
+    c_txt = subst (c_template_struct_from_bytevec_batch_function,
+                   [ ("@PKG", package_name),
+                     ("@HDR_BYTES", "{:d}".format (this_packet_size_bytes (BSV_to_C_packet_bytes, 0))),
+                     ("@MAX_BYTES", "{:d}".format (total_packet_size_bytes (BSV_to_C_packet_bytes))) ])
+    return (h_txt, c_txt)
+
 # ================================================================
 # Generate C-to-BSV API enqueue-functions
 
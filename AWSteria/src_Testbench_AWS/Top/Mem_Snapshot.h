@@ -0,0 +1,45 @@
+// Copyright (c) 2020 Bluespec, Inc.  All Rights Reserved
+
+#pragma once
+
+// ================================================================
+// File format of a snapshot of the simulation's DDR4 memory model.
+
+// If env var AWSTERIA_DDR_SNAPSHOT names a file, the memory model is
+// saved to it at exit.  If env var AWSTERIA_DDR_RESTORE names such a
+// file, it is restored at startup (by c_mem_model_preload, before any
+// preload file).
+// File format (little-endian):
+//     Mem_Snapshot_Hdr
+//     n_pages x Mem_Snapshot_Entry    (which DDR4/offset each page is)
+//     zero padding to a 4 KB boundary (hdr.data_offset)
+//     n_pages x 4 KB of page data, in the same order as the entries
+// All-zero pages are omitted.
+
+// This file is shared by host-side code (which checks that the
+// simulation has restored a snapshot) and simulation-side code.
+
+// ================================================================
+
+#include <stdint.h>
+
+#define MEM_SNAPSHOT_ENV_VAR  "AWSTERIA_DDR_SNAPSHOT"
+#define MEM_RESTORE_ENV_VAR   "AWSTERIA_DDR_RESTORE"
+
+#define MEM_SNAPSHOT_MAGIC    "AWSDDR4S"
+#define MEM_SNAPSHOT_VERSION  1
+
+typedef struct {
+    char      magic [8];
+    uint32_t  version;
+    uint32_t  page_size;
+    uint64_t  n_pages;
+    uint64_t  data_offset;    // file offset of first page (page-aligned)
+} Mem_Snapshot_Hdr;
+
+typedef struct {
+    uint64_t  ddr4_num;
+    uint64_t  byte_offset;    // within DDR4 ddr4_num
+} Mem_Snapshot_Entry;
+
+// ================================================================
@@ -0,0 +1,216 @@
+// Copyright (c) 2020 Bluespec, Inc.  All Rights Reserved
+
+#pragma once
+
+// ================================================================
+// Single-producer/single-consumer (SPSC) byte rings in shared memory.
+
+// These are used as an alternative to the TCP socket between the
+// host-side process (AWS_Sim_Lib) and the simulation process
+// (C_Imported_Functions).  Each ring is a byte stream with the same
+// semantics as the socket, so the bytevec framing (byte [0] is the
+// packet size) is unchanged.
+
+// A 'segment' is a file in /dev/shm, mmap'd by both processes:
+//     SHM_Segment_Hdr | SHM_Ring (C to BSV) | data | SHM_Ring (BSV to C) | data
+// The simulation process (the server) creates the segment; the
+// host-side process (the client) opens it.
+
+// 'head' and 'tail' are free-running byte counts.  Only the consumer
+// writes 'head', only the producer writes 'tail', so no locks are
+// needed, just acquire/release ordering on the two counters.
+
+// This file is shared by host-side and simulation-side code, and is
+// deliberately self-contained (all functions are 'static inline').
+
+// ================================================================
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+
+// ================================================================
+// Environment variable naming the segment (file /dev/shm/<name>).
+// If not set, TCP is used.
+
+#define SHM_ENV_VAR            "AWSTERIA_SHM"
+#define SHM_DIR                "/dev/shm/"
+
+#define SHM_MAGIC              0x4157535f53484d31llu    // "AWS_SHM1"
+#define SHM_RING_DEFAULT_SIZE  (1llu << 20)             // must be a power of 2
+
+// ================================================================
+// Ring header; ring data immediately follows it.
+// Counters are on separate cache lines to avoid false sharing.
+
+typedef struct {
+    uint64_t  head;                 // bytes consumed; written by consumer only
+    uint8_t   pad_head [56];
+    uint64_t  tail;                 // bytes produced; written by producer only
+    uint8_t   pad_tail [56];
+    uint64_t  size;                 // capacity in bytes (power of 2)
+    uint8_t   pad_size [56];
+} SHM_Ring;
+
+// ================================================================
+// Segment header
+
+typedef struct {
+    uint64_t  magic;                // Written last by server, when rings are initialized
+    uint64_t  server_pid;
+    uint64_t  client_connected;     // Written by client after it has mapped the segment
+    uint64_t  ring_size;
+    uint64_t  server_done;          // Trace segments only (see below)
+    uint64_t  client_pid;           // Written by client before client_connected
+    uint8_t   pad [16];
+} SHM_Segment_Hdr;
+
+// ================================================================
+// Peer liveness.
+// A process waiting on a ring checks every SHM_LIVENESS_CHECK_SPINS
+// iterations that the process at the other end (server_pid or
+// client_pid) still exists, so that it does not wait forever on a
+// peer that has exited or crashed.  pid 0 means 'not known yet'.
+
+#define SHM_LIVENESS_CHECK_SPINS  4096
+
+static inline
+bool shm_pid_alive (uint64_t pid)
+{
+    if (pid == 0)
+	return true;
+    return ((kill ((pid_t) pid, 0) == 0) || (errno != ESRCH));
+}
+
+// ================================================================
+// Segment layout
+
+static inline
+uint64_t shm_segment_size (uint64_t ring_size)
+{
+    return (sizeof (SHM_Segment_Hdr) + 2 * (sizeof (SHM_Ring) + ring_size));
+}
+
+static inline
+SHM_Ring *shm_segment_ring_C_to_BSV (SHM_Segment_Hdr *p_hdr)
+{
+    return (SHM_Ring *) (((uint8_t *) p_hdr) + sizeof (SHM_Segment_Hdr));
+}
+
+static inline
+SHM_Ring *shm_segment_ring_BSV_to_C (SHM_Segment_Hdr *p_hdr)
+{
+    return (SHM_Ring *) (((uint8_t *) p_hdr)
+			 + sizeof (SHM_Segment_Hdr)
+			 + sizeof (SHM_Ring) + p_hdr->ring_size);
+}
+
+// ================================================================
+// Trace segments: Tandem Verification trace output, streamed to a
+// concurrently running checker instead of a file (see
+// c_trace_file_open () in C_Imported_Functions.c, and
+// SHM_Trace_Reader.h on the checker side).
+//     SHM_Segment_Hdr | SHM_Ring (BSV to checker) | data
+// The simulation is the producer.  It sets 'server_done' when the trace
+// is closed; the checker then reads what is left in the ring.
+
+#define TRACE_SHM_ENV_VAR       "AWSTERIA_TRACE_SHM"
+#define TRACE_SHM_SIZE_ENV_VAR  "AWSTERIA_TRACE_SHM_SIZE"
+
+#define SHM_TRACE_MAGIC         0x4157535f54524331llu    // "AWS_TRC1"
+#define SHM_TRACE_DEFAULT_SIZE  (1llu << 24)             // must be a power of 2
+
+static inline
+uint64_t shm_trace_segment_size (uint64_t ring_size)
+{
+    return (sizeof (SHM_Segment_Hdr) + sizeof (SHM_Ring) + ring_size);
+}
+
+static inline
+SHM_Ring *shm_trace_segment_ring (SHM_Segment_Hdr *p_hdr)
+{
+    return (SHM_Ring *) (((uint8_t *) p_hdr) + sizeof (SHM_Segment_Hdr));
+}
+
+// ================================================================
+// Ring operations
+
+static inline
+uint8_t *shm_ring_data (SHM_Ring *p_ring)
+{
+    return ((uint8_t *) p_ring) + sizeof (SHM_Ring);
+}
+
+static inline
+void shm_ring_init (SHM_Ring *p_ring, uint64_t size)
+{
+    memset (p_ring, 0, sizeof (SHM_Ring));
+    p_ring->size = size;
+}
+
+// Number of bytes available to the consumer
+static inline
+uint64_t shm_ring_used (SHM_Ring *p_ring)
+{
+    uint64_t tail = __atomic_load_n (& p_ring->tail, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n (& p_ring->head, __ATOMIC_ACQUIRE);
+    return tail - head;
+}
+
+// Number of bytes available to the producer
+static inline
+uint64_t shm_ring_free (SHM_Ring *p_ring)
+{
+    return p_ring->size - shm_ring_used (p_ring);
+}
+
+// Byte at 'offset' from the consumer's position (caller checks it is available)
+static inline
+uint8_t shm_ring_peek (SHM_Ring *p_ring, uint64_t offset)
+{
+    uint64_t head = __atomic_load_n (& p_ring->head, __ATOMIC_RELAXED);
+    return shm_ring_data (p_ring) [(head + offset) & (p_ring->size - 1)];
+}
+
+// Producer: copy in up to n bytes; returns # of bytes actually copied
+static inline
+uint64_t shm_ring_put (SHM_Ring *p_ring, const uint8_t *data, uint64_t n)
+{
+    uint64_t  size = p_ring->size;
+    uint64_t  tail = __atomic_load_n (& p_ring->tail, __ATOMIC_RELAXED);
+    uint64_t  head = __atomic_load_n (& p_ring->head, __ATOMIC_ACQUIRE);
+    uint64_t  avail = size - (tail - head);
+    if (n > avail) n = avail;
+
+    uint64_t  index = (tail & (size - 1));
+    uint64_t  n1    = ((n < (size - index)) ? n : (size - index));
+    memcpy (shm_ring_data (p_ring) + index, data, n1);
+    memcpy (shm_ring_data (p_ring), data + n1, n - n1);
+
+    __atomic_store_n (& p_ring->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+// Consumer: copy out up to n bytes; returns # of bytes actually copied
+static inline
+uint64_t shm_ring_get (SHM_Ring *p_ring, uint8_t *data, uint64_t n)
+{
+    uint64_t  size = p_ring->size;
+    uint64_t  head = __atomic_load_n (& p_ring->head, __ATOMIC_RELAXED);
+    uint64_t  tail = __atomic_load_n (& p_ring->tail, __ATOMIC_ACQUIRE);
+    uint64_t  avail = tail - head;
+    if (n > avail) n = avail;
+
+    uint64_t  index = (head & (size - 1));
+    uint64_t  n1    = ((n < (size - index)) ? n : (size - index));
+    memcpy (data, shm_ring_data (p_ring) + index, n1);
+    memcpy (data + n1, shm_ring_data (p_ring), n - n1);
+
+    __atomic_store_n (& p_ring->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+// ================================================================